@@ -10,7 +10,7 @@
 
 
 static void beacon_send(void* arg);
-static void beacon_sent(socket_t* client);
+static void beacon_receive(socket_t* socket, uint8_t* data, uint16_t length);
 
 
 beacon_t* ICACHE_FLASH_ATTR beacon_create(beacon_t* beacon, uint16_t port) {
@@ -18,12 +18,16 @@ beacon_t* ICACHE_FLASH_ATTR beacon_create(beacon_t* beacon, uint16_t port) {
 
 	if (beacon == NULL) beacon = (beacon_t*) m_malloc(sizeof(beacon_t));
 
-	uint32_t ip = BEACON_ADDRESS;
-	socket_create_udp(&beacon->socket, &ip, port);
-
-	beacon->socket.sent_cb = beacon_sent;
+	// one socket bound to the beacon port, it hears queries and sends both answers and announcements
+	socket_create_udp_listen(&beacon->socket, port);
+	beacon->socket.receive_cb = beacon_receive;
 	beacon->socket.reverse = beacon;
+	beacon->port = port;
 
+	beacon->interval_max = 0;
+	beacon->query.start = NULL;
+	beacon->query.length = 0;
+	beacon->running = false;
 	beacon->send_cb = NULL;
 
 	return beacon;
@@ -40,9 +44,9 @@ void ICACHE_FLASH_ATTR beacon_start(beacon_t* beacon) {
 
 	os_timer_disarm(&beacon->timer);
 	os_timer_setfn(&beacon->timer, beacon_send, beacon);
-	os_timer_arm(&beacon->timer, beacon->interval, false);
 
 	beacon->running = true;
+	beacon_announce(beacon);
 }
 
 void ICACHE_FLASH_ATTR beacon_stop(beacon_t* beacon) {
@@ -53,20 +57,44 @@ void ICACHE_FLASH_ATTR beacon_stop(beacon_t* beacon) {
 	beacon->running = false;
 }
 
+void ICACHE_FLASH_ATTR beacon_announce(beacon_t* beacon) {
+	// something changed, announcements start over at the short interval
+	beacon->next = beacon->interval;
+	if (!beacon->running) return;
+
+	os_timer_disarm(&beacon->timer);
+	os_timer_arm(&beacon->timer, beacon->next, false);
+}
+
 static void ICACHE_FLASH_ATTR beacon_send(void* arg) {
 	beacon_t* beacon = (beacon_t*) arg;
 	if (!beacon->running) return;
 
+	if (beacon->next < beacon->interval_max) beacon->next = MIN(beacon->next * 2, beacon->interval_max);
+	os_timer_arm(&beacon->timer, beacon->next, false);
+
 	if (beacon->send_cb != NULL) beacon->send_cb(beacon);
 
 	if (beacon->data.start == NULL) return;
 	if (beacon->data.length <= 0) return;
 
-	socket_send(&beacon->socket, beacon->data.start, beacon->data.length);
+	uint32_t ip = BEACON_ADDRESS;
+	socket_send_to(&beacon->socket, (uint8_t*) &ip, beacon->port, beacon->data.start, beacon->data.length);
 }
 
-static void beacon_sent(socket_t* client) {
-	beacon_t* beacon = (beacon_t*) client->reverse;
+static void beacon_receive(socket_t* socket, uint8_t* data, uint16_t length) {
+	beacon_t* beacon = (beacon_t*) socket->reverse;
+	if (!beacon->running) return;
+
+	if (length < beacon->query.length) return;
+	if (!array_equals(data, beacon->query.start, beacon->query.length)) return;
+
+	if (beacon->send_cb != NULL) beacon->send_cb(beacon);
+	if (beacon->data.start == NULL) return;
+	if (beacon->data.length <= 0) return;
 
-	os_timer_arm(&beacon->timer, beacon->interval, false);
+	uint8_t ip[4];
+	uint16_t port;
+	if (!socket_remote(socket, ip, &port)) return;
+	socket_send_to(socket, ip, port, beacon->data.start, beacon->data.length);
 }
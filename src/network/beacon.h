@@ -20,11 +20,17 @@ typedef void (*beacon_send_cb_t) (beacon_t* beacon);
 
 struct beacon {
 	socket_t socket;
+	uint16_t port;
 	os_timer_t timer;
-	uint16_t interval;
+	// unsolicited announcements start at interval and back off up to interval_max
+	uint32_t interval;
+	uint32_t interval_max;
+	uint32_t next;
 
 	bool running;
 	buffer_t data;
+	// datagrams starting with the query are answered to the sender, an empty query matches any
+	buffer_t query;
 
 	beacon_send_cb_t send_cb;
 	void* reverse;
@@ -35,6 +41,7 @@ beacon_t* beacon_create(beacon_t* beacon, uint16_t port);
 void beacon_destroy(beacon_t* beacon, bool all);
 void beacon_start(beacon_t* beacon);
 void beacon_stop(beacon_t* beacon);
+void beacon_announce(beacon_t* beacon);
 
 
 #endif /* NETWORK_BEACON_H_ */
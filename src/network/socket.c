@@ -20,6 +20,11 @@ static void sent(void* arg);
 static void error(void* arg, int8_t error);
 static void disconnect(void* arg);
 
+static socket_segment_t* segment_append(socket_t* socket, uint16_t capacity);
+static void segment_release(socket_t* socket);
+static void send_next(socket_t* socket);
+static void flush_timeout(void* arg);
+
 
 static int_table_t* server_table() {
 	static int_table_t* table;
@@ -97,6 +102,14 @@ socket_t* ICACHE_FLASH_ATTR socket_create(socket_t* socket, espconn_t* conn) {
 	socket->conn = conn;
 	socket->conn_destroy = false;
 	socket->server = NULL;
+	socket->head = NULL;
+	socket->tail = NULL;
+	socket->coalesce = NULL;
+	socket->in_flight = 0;
+	socket->flush_delay = 0;
+	socket->retries = 0;
+	os_timer_disarm(&socket->flush_timer);
+	os_timer_setfn(&socket->flush_timer, flush_timeout, socket);
 	socket->reverse = NULL;
 	socket->receive_cb = NULL;
 	socket->sent_cb = NULL;
@@ -146,10 +159,26 @@ socket_t* ICACHE_FLASH_ATTR socket_create_udp(socket_t* socket, void* ip, uint16
 	return socket;
 }
 
+socket_t* ICACHE_FLASH_ATTR socket_create_udp_listen(socket_t* socket, uint16 port) {
+	espconn_t* conn = (espconn_t*) os_zalloc(sizeof(espconn_t));
+	ets_memset(conn, 0, sizeof(espconn_t));
+	conn->proto.udp = (esp_udp*) os_zalloc(sizeof(esp_udp));
+	ets_memset(conn->proto.udp, 0, sizeof(esp_udp));
+
+	conn->type = ESPCONN_UDP;
+	conn->proto.udp->local_port = port;
+	espconn_create(conn);
+
+	socket = socket_create(socket, conn);
+	socket->conn_destroy = true;
+	return socket;
+}
+
 void ICACHE_FLASH_ATTR socket_destroy(socket_t* socket, bool all) {
 	DEBUG_FUNCTION_START();
 
 	socket_close(socket);
+	socket_clear(socket);
 
 	if (socket->conn_destroy) {
 		espconn_delete(socket->conn);
@@ -160,6 +189,148 @@ void ICACHE_FLASH_ATTR socket_destroy(socket_t* socket, bool all) {
 	if (all) os_free(socket);
 }
 
+bool ICACHE_FLASH_ATTR socket_remote(socket_t* socket, uint8_t* ip, uint16_t* port) {
+	remot_info* info = NULL;
+	if (espconn_get_connection_info(socket->conn, &info, 0) != ESPCONN_OK) return false;
+	if (info == NULL) return false;
+
+	m_memcpy(ip, info->remote_ip, 4);
+	*port = info->remote_port;
+	return true;
+}
+
+void ICACHE_FLASH_ATTR socket_send_to(socket_t* socket, uint8_t* ip, uint16_t port, uint8_t* buffer, uint16_t length) {
+	m_memcpy(socket->conn->proto.udp->remote_ip, ip, 4);
+	socket->conn->proto.udp->remote_port = port;
+	espconn_sent(socket->conn, buffer, length);
+}
+
+static socket_segment_t* ICACHE_FLASH_ATTR segment_append(socket_t* socket, uint16_t capacity) {
+	socket_segment_t* segment = (socket_segment_t*) m_malloc(sizeof(socket_segment_t) + capacity);
+	if (segment == NULL) return NULL;
+
+	segment->next = NULL;
+	segment->start = (capacity > 0) ? (uint8_t*) (segment + 1) : NULL;
+	segment->length = 0;
+	segment->capacity = capacity;
+	segment->sent = 0;
+	segment->release_cb = NULL;
+	segment->release_reverse = NULL;
+
+	if (socket->tail == NULL) socket->head = segment;
+	else socket->tail->next = segment;
+	socket->tail = segment;
+
+	return segment;
+}
+
+static void ICACHE_FLASH_ATTR segment_release(socket_t* socket) {
+	socket_segment_t* segment = socket->head;
+	if (segment == NULL) return;
+
+	socket->head = segment->next;
+	if (socket->head == NULL) socket->tail = NULL;
+	if (socket->coalesce == segment) socket->coalesce = NULL;
+
+	if (segment->release_cb != NULL) segment->release_cb(socket, segment->release_reverse);
+	m_free(segment);
+}
+
+static void ICACHE_FLASH_ATTR send_next(socket_t* socket) {
+	if (socket->in_flight > 0) return;
+
+	socket_segment_t* segment = socket->head;
+	if (segment == NULL) return;
+	if (socket->conn == NULL) return;
+	if (socket->conn->state == ESPCONN_CLOSE) return;
+
+	// no more appends once the segment is on the wire
+	if (socket->coalesce == segment) socket->coalesce = NULL;
+
+	uint16_t length = MIN(segment->length - segment->sent, SOCKET_SEGMENT_LENGTH_MAX);
+	sint8 result = espconn_sent(socket->conn, segment->start + segment->sent, length);
+	if (result != ESPCONN_OK) {
+		DEBUG("send failed %d", result);
+		// lwip is short of buffers, the segment is offered again from the flush timer
+		socket->retries++;
+		os_timer_disarm(&socket->flush_timer);
+		os_timer_arm(&socket->flush_timer, SOCKET_RETRY_DELAY, false);
+		return;
+	}
+	socket->retries = 0;
+	socket->in_flight = length;
+}
+
+static void ICACHE_FLASH_ATTR flush_timeout(void* arg) {
+	socket_t* socket = (socket_t*) arg;
+	if (socket->retries > SOCKET_RETRY_MAX) {
+		// the connection takes nothing anymore, the owner cleans up in its disconnect callback
+		DEBUG_FUNCTION("send given up");
+		socket_clear(socket);
+		socket_close(socket);
+		return;
+	}
+	socket_flush(socket);
+}
+
+bool ICACHE_FLASH_ATTR socket_queue(socket_t* socket, uint8_t* buffer, uint16_t length, socket_release_cb_t release_cb, void* reverse) {
+	if (length <= 0) {
+		if (release_cb != NULL) release_cb(socket, reverse);
+		return true;
+	}
+
+	socket_segment_t* segment = segment_append(socket, 0);
+	if (segment == NULL) {
+		DEBUG_FUNCTION("out of memory");
+		return false;
+	}
+	segment->start = buffer;
+	segment->length = length;
+	segment->release_cb = release_cb;
+	segment->release_reverse = reverse;
+
+	socket_flush(socket);
+	return true;
+}
+
+bool ICACHE_FLASH_ATTR socket_write(socket_t* socket, uint8_t* buffer, uint16_t length) {
+	if (length <= 0) return true;
+
+	socket_segment_t* segment = socket->coalesce;
+	if ((segment == NULL) || (segment->capacity - segment->length < length)) {
+		segment = segment_append(socket, MAX(length, SOCKET_COALESCE_LENGTH));
+		if (segment == NULL) {
+			DEBUG_FUNCTION("out of memory");
+			return false;
+		}
+		socket->coalesce = segment;
+	}
+
+	m_memcpy(segment->start + segment->length, buffer, length);
+	segment->length += length;
+
+	if (socket->flush_delay > 0) {
+		os_timer_disarm(&socket->flush_timer);
+		os_timer_arm(&socket->flush_timer, socket->flush_delay, false);
+	} else {
+		socket_flush(socket);
+	}
+	return true;
+}
+
+void ICACHE_FLASH_ATTR socket_flush(socket_t* socket) {
+	os_timer_disarm(&socket->flush_timer);
+	socket->coalesce = NULL;
+	send_next(socket);
+}
+
+void ICACHE_FLASH_ATTR socket_clear(socket_t* socket) {
+	os_timer_disarm(&socket->flush_timer);
+	while (socket->head != NULL) segment_release(socket);
+	socket->in_flight = 0;
+	socket->retries = 0;
+}
+
 static void receive(void* arg, char* data, uint16_t length) {
 	espconn_t* conn = (espconn_t*) arg;
 
@@ -172,6 +343,15 @@ static void sent(void* arg) {
 	espconn_t* conn = (espconn_t*) arg;
 
 	socket_t* socket = (socket_t*) conn->reverse;
+
+	if (socket->in_flight > 0) {
+		socket_segment_t* segment = socket->head;
+		segment->sent += socket->in_flight;
+		socket->in_flight = 0;
+		if (segment->sent >= segment->length) segment_release(socket);
+		send_next(socket);
+	}
+
 	if (socket->sent_cb != NULL) socket->sent_cb(socket);
 	else DEBUG_FUNCTION("uncatched sent");
 }
@@ -180,6 +360,7 @@ static void error(void* arg, int8_t error) {
 	espconn_t* conn = (espconn_t*) arg;
 
 	socket_t* socket = (socket_t*) conn->reverse;
+	socket_clear(socket);
 	if (socket->error_cb != NULL) socket->error_cb(socket, error);
 	else DEBUG_FUNCTION("uncatched error");
 }
@@ -188,6 +369,7 @@ static void disconnect(void* arg) {
 	espconn_t* conn = (espconn_t*) arg;
 
 	socket_t* socket = (socket_t*) conn->reverse;
+	socket_clear(socket);
 	if (socket->disconnect_cb != NULL) socket->disconnect_cb(socket);
 	else DEBUG_FUNCTION("uncatched disconnect");
 }
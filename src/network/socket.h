@@ -4,6 +4,7 @@
 
 
 #include "c_types.h"
+#include "os_type.h"
 #include "ip_addr.h"
 #include "espconn.h"
 
@@ -14,16 +15,23 @@
 
 #define SERVER_TABLE_BUCKETS 8
 
+#define SOCKET_SEGMENT_LENGTH_MAX 1460
+#define SOCKET_COALESCE_LENGTH 256
+#define SOCKET_RETRY_DELAY 10
+#define SOCKET_RETRY_MAX 20
+
 
 typedef struct espconn espconn_t;
 typedef struct server_socket server_socket_t;
 typedef struct socket socket_t;
+typedef struct socket_segment socket_segment_t;
 
 typedef void (*server_connect_cb_t) (server_socket_t* server_socket, socket_t* client);
 typedef void (*socket_receive_cb_t) (socket_t* client, uint8_t* data, uint16_t length);
 typedef void (*socket_sent_cb_t) (socket_t* client);
 typedef void (*socket_error_cb_t) (socket_t* client, int8_t error);
 typedef void (*socket_disconnect_cb_t) (socket_t* client);
+typedef void (*socket_release_cb_t) (socket_t* client, void* reverse);
 
 
 struct server_socket {
@@ -34,12 +42,31 @@ struct server_socket {
 	server_connect_cb_t connect_cb;
 };
 
+struct socket_segment {
+	socket_segment_t* next;
+	uint8_t* start;
+	uint16_t length;
+	uint16_t capacity;
+	uint16_t sent;
+
+	socket_release_cb_t release_cb;
+	void* release_reverse;
+};
+
 struct socket {
 	// TODO: remove pointer
 	espconn_t* conn;
 	bool conn_destroy;
 	server_socket_t* server;
 
+	socket_segment_t* head;
+	socket_segment_t* tail;
+	socket_segment_t* coalesce;
+	uint16_t in_flight;
+	uint16_t flush_delay;
+	os_timer_t flush_timer;
+	uint8_t retries;
+
 	void* reverse;
 	socket_receive_cb_t receive_cb;
 	socket_sent_cb_t sent_cb;
@@ -64,6 +91,7 @@ static inline uint16_t server_socket_port(server_socket_t* server) {
 socket_t* socket_create(socket_t* socket, espconn_t* conn);
 socket_t* socket_create_tcp(socket_t* socket, void* ip, uint16_t port);
 socket_t* socket_create_udp(socket_t* socket, void* ip, uint16_t port);
+socket_t* socket_create_udp_listen(socket_t* socket, uint16_t port);
 void socket_destroy(socket_t* socket, bool all);
 static inline void socket_close(socket_t* socket) {
 	DEBUG_FUNCTION_START();
@@ -75,6 +103,21 @@ static inline void socket_close(socket_t* socket) {
 static inline void socket_send(socket_t* socket, uint8_t* buffer, uint16_t length) {
 	espconn_sent(socket->conn, buffer, length);
 }
+static inline void socket_hold(socket_t* socket) {
+	espconn_recv_hold(socket->conn);
+}
+static inline void socket_unhold(socket_t* socket) {
+	espconn_recv_unhold(socket->conn);
+}
+bool socket_remote(socket_t* socket, uint8_t* ip, uint16_t* port);
+void socket_send_to(socket_t* socket, uint8_t* ip, uint16_t port, uint8_t* buffer, uint16_t length);
+bool socket_queue(socket_t* socket, uint8_t* buffer, uint16_t length, socket_release_cb_t release_cb, void* reverse);
+bool socket_write(socket_t* socket, uint8_t* buffer, uint16_t length);
+void socket_flush(socket_t* socket);
+void socket_clear(socket_t* socket);
+static inline bool socket_idle(socket_t* socket) {
+	return socket->head == NULL;
+}
 
 
 #endif /* INCLUDE_SOCKET_H_ */
@@ -88,6 +88,7 @@ bool ICACHE_FLASH_ATTR config_save(config_t* config) {
 		DEBUG_FUNCTION("erase failed");
 		return false;
 	}
+	config->position = 0;
 
 	// write data
 	config->head.name.buffer = data_write_auto(config, config->server->name.start, stack_buffer_size(&config->server->name));
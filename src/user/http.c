@@ -0,0 +1,232 @@
+
+#include "http.h"
+
+#include "osapi.h"
+
+#include "memory.h"
+#include "util.h"
+
+#include "debug/debug_on.h"
+
+
+#define HTTP_OCTET_STREAM "application/octet-stream"
+
+
+static ir_http_result_t request_line(ir_http_t* http);
+static ir_http_result_t header(ir_http_t* http);
+static uint8_t method(string_t token);
+static bool starts_with(string_t* string, const char* prefix);
+static bool write_text(stream_t* s, const char* text);
+static const char* reason(uint16_t code);
+
+
+void ICACHE_FLASH_ATTR ir_http_reset(ir_http_t* http) {
+	m_memset(http, 0, sizeof(ir_http_t));
+}
+
+ir_http_result_t ICACHE_FLASH_ATTR ir_http_push(ir_http_t* http, char c) {
+	if (c == '\r') return IR_HTTP_BUSY;
+	if (c != '\n') {
+		// only prefixes of a line are of interest, the tail of a long header is dropped
+		if (http->line_length < sizeof(http->line)) http->line[http->line_length++] = c;
+		else http->truncated = true;
+		return IR_HTTP_BUSY;
+	}
+
+	ir_http_result_t result = (http->state == 0) ? request_line(http) : header(http);
+	http->line_length = 0;
+	http->truncated = false;
+	return result;
+}
+
+static ir_http_result_t ICACHE_FLASH_ATTR request_line(ir_http_t* http) {
+	if (http->truncated) return IR_HTTP_MALFORMED;
+
+	char* end = http->line + http->line_length;
+	char* space = (char*) array_find_char((uint8_t*) http->line, http->line_length, ' ');
+	if (space == NULL) return IR_HTTP_MALFORMED;
+	http->method = method((string_t) {http->line, space - http->line});
+
+	char* target = space + 1;
+	space = (char*) array_find_char((uint8_t*) target, end - target, ' ');
+	if (space == NULL) return IR_HTTP_MALFORMED;
+	char* query = (char*) array_find_char((uint8_t*) target, space - target, '?');
+	uint8_t length = ((query != NULL) ? query : space) - target;
+	if (length > IR_HTTP_PATH_LENGTH_MAX) return IR_HTTP_MALFORMED;
+	m_memcpy(http->path, target, length);
+	http->path_length = length;
+
+	if (query != NULL) {
+		length = space - query - 1;
+		if (length > IR_HTTP_QUERY_LENGTH_MAX) return IR_HTTP_MALFORMED;
+		m_memcpy(http->query, query + 1, length);
+		http->query_length = length;
+	}
+
+	string_t version = {space + 1, end - space - 1};
+	if (!starts_with(&version, "HTTP/1.")) return IR_HTTP_MALFORMED;
+	http->keep_alive = (version.length > 7) && (version.buffer[7] != '0');
+
+	http->state++;
+	return IR_HTTP_BUSY;
+}
+
+static ir_http_result_t ICACHE_FLASH_ATTR header(ir_http_t* http) {
+	if (http->line_length == 0) return IR_HTTP_DONE;
+
+	// header names and the values we look at are case insensitive
+	uint8_t i = 0;
+	while (i < http->line_length) {
+		char c = http->line[i];
+		if (BETWEEN(c, 'A', 'Z')) http->line[i] = c - 'A' + 'a';
+		i++;
+	}
+
+	string_t line = {http->line, http->line_length};
+	char* end = http->line + http->line_length;
+	char* colon = (char*) array_find_char((uint8_t*) http->line, http->line_length, ':');
+	if (colon == NULL) return IR_HTTP_BUSY;
+	char* value = skip_chars(colon + 1, end - colon - 1, is_whitespace);
+	if (value == NULL) value = end;
+	uint8_t length = end - value;
+
+	if (starts_with(&line, "content-length:")) {
+		uint32_t content_length = 0;
+		if (length <= 0) return IR_HTTP_MALFORMED;
+		while (value < end) {
+			if (!BETWEEN(*value, '0', '9')) return IR_HTTP_MALFORMED;
+			content_length = content_length * 10 + (*value++ - '0');
+			if (content_length > 0xFFFF) return IR_HTTP_MALFORMED;
+		}
+		http->content_length = content_length;
+	} else if (starts_with(&line, "connection:")) {
+		if (array_find_array((uint8_t*) value, length, (uint8_t*) "close", 5) != NULL) http->keep_alive = false;
+		else if (array_find_array((uint8_t*) value, length, (uint8_t*) "keep-alive", 10) != NULL) http->keep_alive = true;
+	} else if (starts_with(&line, "content-type:")) {
+		string_t type = {value, length};
+		http->binary = starts_with(&type, HTTP_OCTET_STREAM);
+	} else if (starts_with(&line, "expect:")) {
+		http->expect_continue = array_find_array((uint8_t*) value, length, (uint8_t*) "100-continue", 12) != NULL;
+	} else if (starts_with(&line, "accept:")) {
+		http->accept_binary = array_find_array((uint8_t*) value, length, (uint8_t*) HTTP_OCTET_STREAM,
+				sizeof(HTTP_OCTET_STREAM) - 1) != NULL;
+	}
+
+	return IR_HTTP_BUSY;
+}
+
+static uint8_t ICACHE_FLASH_ATTR method(string_t token) {
+	string_matcher_t matcher = {0};
+	if (string_match(token, &matcher, "GET", 3) == STRING_MATCH_TRUE) return IR_HTTP_GET;
+	if (string_match(token, &matcher, "POST", 4) == STRING_MATCH_TRUE) return IR_HTTP_POST;
+	if (string_match(token, &matcher, "PUT", 3) == STRING_MATCH_TRUE) return IR_HTTP_PUT;
+	if (string_match(token, &matcher, "DELETE", 6) == STRING_MATCH_TRUE) return IR_HTTP_DELETE;
+	return IR_HTTP_OTHER;
+}
+
+static bool ICACHE_FLASH_ATTR starts_with(string_t* string, const char* prefix) {
+	return string_starts_with(string, NULL, prefix, os_strlen(prefix)) == STRING_MATCH_TRUE;
+}
+
+bool ICACHE_FLASH_ATTR ir_http_path(ir_http_t* http, const char* path, uint8_t length, string_t* rest) {
+	string_t full = {http->path, http->path_length};
+	if (string_starts_with(&full, NULL, path, length) != STRING_MATCH_TRUE) return false;
+
+	rest->buffer = http->path + length;
+	rest->length = http->path_length - length;
+	if (rest->length <= 0) return true;
+	if (*rest->buffer != '/') return false;
+	rest->buffer++;
+	rest->length--;
+	return true;
+}
+
+bool ICACHE_FLASH_ATTR ir_http_query(ir_http_t* http, const char* name, uint8_t length, uint32_t* value) {
+	// only numbers are ever passed, a parameter that is not one counts as missing
+	char* p = http->query;
+	char* end = http->query + http->query_length;
+	while (p < end) {
+		char* next = (char*) array_find_char((uint8_t*) p, end - p, '&');
+		if (next == NULL) next = end;
+
+		if ((next - p > length) && (p[length] == '=') && array_equals((uint8_t*) p, (uint8_t*) name, length)) {
+			uint32_t number = 0;
+			p += length + 1;
+			if (p >= next) return false;
+			while (p < next) {
+				if (!BETWEEN(*p, '0', '9')) return false;
+				number = number * 10 + (*p++ - '0');
+				if (number > 0xFFFF) return false;
+			}
+			*value = number;
+			return true;
+		}
+		p = next + 1;
+	}
+
+	return false;
+}
+
+uint8_t ICACHE_FLASH_ATTR ir_http_digits(uint32_t number) {
+	uint8_t n = 1;
+	while (number >= 10) {
+		number /= 10;
+		n++;
+	}
+	return n;
+}
+
+bool ICACHE_FLASH_ATTR ir_http_write_number(stream_t* s, uint32_t number) {
+	char buffer[10];
+	uint8_t n = ir_http_digits(number);
+	uint8_t i = n;
+	do {
+		buffer[--i] = '0' + number % 10;
+		number /= 10;
+	} while (i > 0);
+	return stream_write(s, (uint8_t*) buffer, n);
+}
+
+bool ICACHE_FLASH_ATTR ir_http_write_head(stream_t* s, uint16_t code, bool binary, uint16_t length, bool keep_alive) {
+	bool done = true;
+	done &= write_text(s, "HTTP/1.1 ");
+	done &= ir_http_write_number(s, code);
+	done &= write_text(s, " ");
+	done &= write_text(s, reason(code));
+	done &= write_text(s, "\r\nContent-Type: ");
+	done &= write_text(s, binary ? HTTP_OCTET_STREAM : "text/plain");
+	done &= write_text(s, "\r\nContent-Length: ");
+	done &= ir_http_write_number(s, length);
+	done &= write_text(s, "\r\nConnection: ");
+	done &= write_text(s, keep_alive ? "keep-alive" : "close");
+	done &= write_text(s, "\r\n\r\n");
+	return done;
+}
+
+bool ICACHE_FLASH_ATTR ir_http_write_continue(stream_t* s) {
+	return write_text(s, "HTTP/1.1 100 Continue\r\n\r\n");
+}
+
+static bool ICACHE_FLASH_ATTR write_text(stream_t* s, const char* text) {
+	return stream_write(s, (uint8_t*) text, os_strlen(text));
+}
+
+static const char* ICACHE_FLASH_ATTR reason(uint16_t code) {
+	switch (code) {
+	case 200:
+		return "OK";
+	case 400:
+		return "Bad Request";
+	case 404:
+		return "Not Found";
+	case 408:
+		return "Request Timeout";
+	case 413:
+		return "Payload Too Large";
+	case 503:
+		return "Service Unavailable";
+	case 504:
+		return "Gateway Timeout";
+	}
+	return "Internal Server Error";
+}
@@ -0,0 +1,71 @@
+
+#ifndef HTTP_H_
+#define HTTP_H_
+
+
+#include "c_types.h"
+
+#include "util.h"
+
+
+#define IR_HTTP_LINE_LENGTH_MAX 64
+#define IR_HTTP_PATH_LENGTH_MAX 32
+#define IR_HTTP_QUERY_LENGTH_MAX 32
+
+
+typedef enum ir_http_method ir_http_method_t;
+typedef enum ir_http_result ir_http_result_t;
+
+typedef struct ir_http ir_http_t;
+
+
+enum ir_http_method {
+	IR_HTTP_GET,
+	IR_HTTP_POST,
+	IR_HTTP_PUT,
+	IR_HTTP_DELETE,
+	IR_HTTP_OTHER
+};
+
+enum ir_http_result {
+	IR_HTTP_BUSY,
+	IR_HTTP_DONE,
+	IR_HTTP_MALFORMED
+};
+
+struct ir_http {
+	uint8_t state;
+	char line[IR_HTTP_LINE_LENGTH_MAX];
+	uint8_t line_length;
+	bool truncated;
+
+	uint8_t method;
+	char path[IR_HTTP_PATH_LENGTH_MAX];
+	uint8_t path_length;
+	char query[IR_HTTP_QUERY_LENGTH_MAX];
+	uint8_t query_length;
+	uint16_t content_length;
+	bool keep_alive;
+	bool binary;
+	bool accept_binary;
+	bool expect_continue;
+
+	// compact text bodies are parsed number by number
+	uint32_t number;
+	bool digits;
+	bool frequency;
+};
+
+
+void ir_http_reset(ir_http_t* http);
+ir_http_result_t ir_http_push(ir_http_t* http, char c);
+bool ir_http_path(ir_http_t* http, const char* path, uint8_t length, string_t* rest);
+bool ir_http_query(ir_http_t* http, const char* name, uint8_t length, uint32_t* value);
+
+uint8_t ir_http_digits(uint32_t number);
+bool ir_http_write_number(stream_t* s, uint32_t number);
+bool ir_http_write_head(stream_t* s, uint16_t code, bool binary, uint16_t length, bool keep_alive);
+bool ir_http_write_continue(stream_t* s);
+
+
+#endif /* HTTP_H_ */
@@ -0,0 +1,413 @@
+
+#include "library.h"
+
+#include "osapi.h"
+#include "spi_flash.h"
+
+#include "memory.h"
+#include "util.h"
+
+#include "debug/debug_on.h"
+
+
+#define CHUNK_LENGTH 64
+
+
+static uint32_t sector_address(ir_library_t* library, uint8_t sector);
+static uint16_t record_size(uint8_t name_length, uint16_t length);
+static uint32_t name_hash(uint8_t* name, uint8_t name_length);
+
+static bool flash_read(uint32_t address, void* buffer, uint16_t length);
+static bool flash_write(uint32_t address, void* buffer, uint16_t length);
+static bool flash_copy(uint32_t from, uint32_t to, uint16_t length);
+static bool flash_state(uint32_t address, uint32_t state);
+
+static ir_library_entry_t* entry_alloc(ir_library_t* library);
+static void entry_index(ir_library_t* library, ir_library_entry_t* entry);
+static void entry_unindex(ir_library_t* library, ir_library_entry_t* entry);
+static void entries_clear(ir_library_t* library);
+
+static bool scan(ir_library_t* library);
+static bool compact(ir_library_t* library);
+
+
+static uint32_t ICACHE_FLASH_ATTR sector_address(ir_library_t* library, uint8_t sector) {
+	return library->address + sector * SPI_FLASH_SEC_SIZE;
+}
+
+static uint16_t ICACHE_FLASH_ATTR record_size(uint8_t name_length, uint16_t length) {
+	return sizeof(ir_library_record_t) + ir_library_padded(name_length) + ir_library_padded(length);
+}
+
+static uint32_t ICACHE_FLASH_ATTR name_hash(uint8_t* name, uint8_t name_length) {
+	// fnv-1a
+	uint32_t hash = 2166136261;
+	uint8_t i = 0;
+	while (i < name_length) {
+		hash ^= name[i++];
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+// spi flash only works on aligned words, everything goes through a small bounce buffer
+static bool ICACHE_FLASH_ATTR flash_read(uint32_t address, void* buffer, uint16_t length) {
+	uint32_t chunk[CHUNK_LENGTH / 4];
+	uint8_t* b = (uint8_t*) buffer;
+
+	while (length > 0) {
+		uint16_t n = MIN(length, CHUNK_LENGTH);
+		if (spi_flash_read(address, chunk, ir_library_padded(n)) != SPI_FLASH_RESULT_OK) return false;
+		m_memcpy(b, chunk, n);
+		address += n;
+		b += n;
+		length -= n;
+	}
+
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR flash_write(uint32_t address, void* buffer, uint16_t length) {
+	uint32_t chunk[CHUNK_LENGTH / 4];
+	uint8_t* b = (uint8_t*) buffer;
+
+	while (length > 0) {
+		uint16_t n = MIN(length, CHUNK_LENGTH);
+		uint16_t padded = ir_library_padded(n);
+		m_memset(chunk, 0xFF, padded);
+		m_memcpy(chunk, b, n);
+		if (spi_flash_write(address, chunk, padded) != SPI_FLASH_RESULT_OK) return false;
+		address += padded;
+		b += n;
+		length -= n;
+	}
+
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR flash_copy(uint32_t from, uint32_t to, uint16_t length) {
+	uint32_t chunk[CHUNK_LENGTH / 4];
+
+	while (length > 0) {
+		uint16_t n = MIN(length, CHUNK_LENGTH);
+		if (spi_flash_read(from, chunk, n) != SPI_FLASH_RESULT_OK) return false;
+		if (spi_flash_write(to, chunk, n) != SPI_FLASH_RESULT_OK) return false;
+		from += n;
+		to += n;
+		length -= n;
+	}
+
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR flash_state(uint32_t address, uint32_t state) {
+	// state is the last word of a record, writing it only clears bits
+	return spi_flash_write(address + sizeof(ir_library_record_t) - 4, &state, 4) == SPI_FLASH_RESULT_OK;
+}
+
+static ir_library_entry_t* ICACHE_FLASH_ATTR entry_alloc(ir_library_t* library) {
+	uint8_t i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) return entry;
+	}
+	return NULL;
+}
+
+static void ICACHE_FLASH_ATTR entry_index(ir_library_t* library, ir_library_entry_t* entry) {
+	int_table_put(library->ids, entry->id, entry);
+	if (entry->name_length > 0) int_table_put(library->names, entry->hash, entry);
+	library->count++;
+}
+
+static void ICACHE_FLASH_ATTR entry_unindex(ir_library_t* library, ir_library_entry_t* entry) {
+	int_table_remove(library->ids, entry->id);
+	if ((entry->name_length > 0) && (int_table_get(library->names, entry->hash) == entry)) {
+		int_table_remove(library->names, entry->hash);
+	}
+	entry->id = IR_LIBRARY_ID_NONE;
+	library->count--;
+}
+
+static void ICACHE_FLASH_ATTR entries_clear(ir_library_t* library) {
+	int_table_clear(library->ids);
+	int_table_clear(library->names);
+	m_memset(library->entries, 0, sizeof(library->entries));
+	library->count = 0;
+}
+
+ir_library_t* ICACHE_FLASH_ATTR ir_library_create(ir_library_t* library, uint32_t address) {
+	if (library == NULL) library = (ir_library_t*) m_malloc(sizeof(ir_library_t));
+
+	library->address = address;
+	library->sector = 0;
+	library->generation = 0;
+	library->position = sizeof(ir_library_head_t);
+	library->garbage = 0;
+
+	library->ids = int_table_create(IR_LIBRARY_BUCKETS);
+	library->names = int_table_create(IR_LIBRARY_BUCKETS);
+	m_memset(library->entries, 0, sizeof(library->entries));
+	library->count = 0;
+
+	return library;
+}
+
+void ICACHE_FLASH_ATTR ir_library_destroy(ir_library_t* library, bool all) {
+	int_table_destroy(library->ids);
+	int_table_destroy(library->names);
+
+	if (all) m_free(library);
+}
+
+bool ICACHE_FLASH_ATTR ir_library_load(ir_library_t* library) {
+	DEBUG_FUNCTION_START();
+
+	ir_library_head_t heads[IR_LIBRARY_SECTORS];
+	bool found = false;
+	uint8_t i = 0;
+	while (i < IR_LIBRARY_SECTORS) {
+		if (!flash_read(sector_address(library, i), &heads[i], sizeof(ir_library_head_t))) return false;
+		if (heads[i].magic == IR_LIBRARY_MAGIC) {
+			// the newest generation wins, a compaction interrupted before its head was written is ignored
+			if (!found || ((int32_t) (heads[i].generation - library->generation) > 0)) {
+				library->sector = i;
+				library->generation = heads[i].generation;
+				found = true;
+			}
+		}
+		i++;
+	}
+
+	if (!found) {
+		DEBUG_FUNCTION("no library found, format");
+		return ir_library_format(library);
+	}
+
+	return scan(library);
+}
+
+bool ICACHE_FLASH_ATTR ir_library_format(ir_library_t* library) {
+	DEBUG_FUNCTION_START();
+
+	entries_clear(library);
+	library->sector = 0;
+	library->generation++;
+	library->position = sizeof(ir_library_head_t);
+	library->garbage = 0;
+
+	uint32_t address = sector_address(library, library->sector);
+	if (spi_flash_erase_sector(address >> 12) != SPI_FLASH_RESULT_OK) {
+		DEBUG_FUNCTION("erase failed");
+		return false;
+	}
+
+	ir_library_head_t head = {IR_LIBRARY_MAGIC, library->generation};
+	return spi_flash_write(address, (uint32_t*) &head, sizeof(head)) == SPI_FLASH_RESULT_OK;
+}
+
+static bool ICACHE_FLASH_ATTR scan(ir_library_t* library) {
+	entries_clear(library);
+	library->position = sizeof(ir_library_head_t);
+	library->garbage = 0;
+
+	uint32_t address = sector_address(library, library->sector);
+	while (library->position + sizeof(ir_library_record_t) <= SPI_FLASH_SEC_SIZE) {
+		ir_library_record_t record;
+		if (!flash_read(address + library->position, &record, sizeof(record))) return false;
+		// erased flash marks the end of the log
+		if (*((uint32_t*) &record) == IR_LIBRARY_STATE_ERASED) break;
+
+		uint16_t size = record_size(record.name_length, record.length);
+		if (library->position + size > SPI_FLASH_SEC_SIZE) {
+			DEBUG_FUNCTION("broken record");
+			break;
+		}
+
+		if (record.state == IR_LIBRARY_STATE_VALID) {
+			// a put interrupted before the old record was deleted leaves two, the later one wins
+			ir_library_entry_t* entry = ir_library_get(library, record.id);
+			if (entry != NULL) {
+				library->garbage += record_size(entry->name_length, entry->length);
+				entry_unindex(library, entry);
+			}
+
+			entry = entry_alloc(library);
+			if (entry != NULL) {
+				uint8_t name[IR_LIBRARY_NAME_LENGTH_MAX];
+				uint8_t name_length = MIN(record.name_length, IR_LIBRARY_NAME_LENGTH_MAX);
+				flash_read(address + library->position + sizeof(record), name, name_length);
+
+				entry->id = record.id;
+				entry->kind = record.kind;
+				entry->name_length = name_length;
+				entry->length = record.length;
+				entry->offset = library->position;
+				entry->frequency = record.frequency;
+				entry->hash = name_hash(name, name_length);
+				entry_index(library, entry);
+			} else {
+				DEBUG_FUNCTION("index full");
+				library->garbage += size;
+			}
+		} else {
+			library->garbage += size;
+		}
+
+		library->position += size;
+	}
+
+	DEBUG("library %d entries, %d used, %d garbage", library->count, library->position, library->garbage);
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR compact(ir_library_t* library) {
+	DEBUG_FUNCTION_START();
+
+	uint8_t sector = library->sector ^ 1;
+	uint32_t from = sector_address(library, library->sector);
+	uint32_t to = sector_address(library, sector);
+	uint16_t position = sizeof(ir_library_head_t);
+
+	if (spi_flash_erase_sector(to >> 12) != SPI_FLASH_RESULT_OK) {
+		DEBUG_FUNCTION("erase failed");
+		return false;
+	}
+
+	uint8_t i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+
+		uint16_t size = record_size(entry->name_length, entry->length);
+		if (!flash_copy(from + entry->offset, to + position, size)) {
+			// the old sector still has the newer head, start over from there
+			ir_library_load(library);
+			return false;
+		}
+		entry->offset = position;
+		position += size;
+	}
+
+	// the head goes last, until then the old sector stays the valid one
+	ir_library_head_t head = {IR_LIBRARY_MAGIC, library->generation + 1};
+	if (spi_flash_write(to, (uint32_t*) &head, sizeof(head)) != SPI_FLASH_RESULT_OK) {
+		ir_library_load(library);
+		return false;
+	}
+
+	library->sector = sector;
+	library->generation++;
+	library->position = position;
+	library->garbage = 0;
+
+	return true;
+}
+
+ir_library_entry_t* ICACHE_FLASH_ATTR ir_library_get(ir_library_t* library, uint16_t id) {
+	return (ir_library_entry_t*) int_table_get(library->ids, id);
+}
+
+ir_library_entry_t* ICACHE_FLASH_ATTR ir_library_find(ir_library_t* library, uint8_t* name, uint8_t name_length) {
+	if ((name_length <= 0) || (name_length > IR_LIBRARY_NAME_LENGTH_MAX)) return NULL;
+
+	ir_library_entry_t* entry = (ir_library_entry_t*) int_table_get(library->names, name_hash(name, name_length));
+	if (entry == NULL) return NULL;
+	if (entry->name_length != name_length) return NULL;
+
+	uint8_t tmp[IR_LIBRARY_NAME_LENGTH_MAX];
+	if (!ir_library_read_name(library, entry, tmp)) return NULL;
+	if (!array_equals(tmp, name, name_length)) return NULL;
+
+	return entry;
+}
+
+bool ICACHE_FLASH_ATTR ir_library_read(ir_library_t* library, ir_library_entry_t* entry, void* buffer) {
+	uint32_t address = sector_address(library, library->sector) + entry->offset
+			+ sizeof(ir_library_record_t) + ir_library_padded(entry->name_length);
+	return flash_read(address, buffer, entry->length);
+}
+
+bool ICACHE_FLASH_ATTR ir_library_read_name(ir_library_t* library, ir_library_entry_t* entry, uint8_t* name) {
+	uint32_t address = sector_address(library, library->sector) + entry->offset + sizeof(ir_library_record_t);
+	return flash_read(address, name, entry->name_length);
+}
+
+bool ICACHE_FLASH_ATTR ir_library_put(ir_library_t* library, uint16_t id, uint8_t kind, uint8_t* name, uint8_t name_length,
+		uint32_t frequency, void* data, uint16_t length) {
+	DEBUG_FUNCTION_START();
+
+	if (id == IR_LIBRARY_ID_NONE) return false;
+	if (name_length > IR_LIBRARY_NAME_LENGTH_MAX) return false;
+
+	ir_library_entry_t* named = ir_library_find(library, name, name_length);
+	if ((named != NULL) && (named->id != id)) {
+		DEBUG_FUNCTION("name taken");
+		return false;
+	}
+	if ((name_length > 0) && (named == NULL) && (int_table_get(library->names, name_hash(name, name_length)) != NULL)) {
+		DEBUG_FUNCTION("name collision");
+		return false;
+	}
+
+	ir_library_entry_t* old = ir_library_get(library, id);
+	if ((old == NULL) && (library->count >= IR_LIBRARY_ENTRIES)) {
+		DEBUG_FUNCTION("index full");
+		return false;
+	}
+
+	uint16_t size = record_size(name_length, length);
+	if (library->position + size > SPI_FLASH_SEC_SIZE) {
+		if ((library->garbage <= 0) || !compact(library)) return false;
+		if (library->position + size > SPI_FLASH_SEC_SIZE) {
+			DEBUG_FUNCTION("library full");
+			return false;
+		}
+	}
+
+	uint32_t address = sector_address(library, library->sector) + library->position;
+	ir_library_record_t record = {id, kind, name_length, length, 0xFFFF, frequency, IR_LIBRARY_STATE_ERASED};
+	bool done = true;
+	done &= flash_write(address, &record, sizeof(record));
+	done &= flash_write(address + sizeof(record), name, name_length);
+	done &= flash_write(address + sizeof(record) + ir_library_padded(name_length), data, length);
+	// the record only counts once it is completely written
+	done &= flash_state(address, IR_LIBRARY_STATE_VALID);
+	library->position += size;
+	if (!done) {
+		DEBUG_FUNCTION("write failed");
+		library->garbage += size;
+		return false;
+	}
+
+	if (old != NULL) {
+		flash_state(sector_address(library, library->sector) + old->offset, IR_LIBRARY_STATE_DELETED);
+		library->garbage += record_size(old->name_length, old->length);
+		entry_unindex(library, old);
+	}
+
+	ir_library_entry_t* entry = entry_alloc(library);
+	entry->id = id;
+	entry->kind = kind;
+	entry->name_length = name_length;
+	entry->length = length;
+	entry->offset = address - sector_address(library, library->sector);
+	entry->frequency = frequency;
+	entry->hash = name_hash(name, name_length);
+	entry_index(library, entry);
+
+	return true;
+}
+
+bool ICACHE_FLASH_ATTR ir_library_delete(ir_library_t* library, uint16_t id) {
+	DEBUG_FUNCTION_START();
+
+	ir_library_entry_t* entry = ir_library_get(library, id);
+	if (entry == NULL) return false;
+
+	if (!flash_state(sector_address(library, library->sector) + entry->offset, IR_LIBRARY_STATE_DELETED)) return false;
+	library->garbage += record_size(entry->name_length, entry->length);
+	entry_unindex(library, entry);
+
+	return true;
+}
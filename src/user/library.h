@@ -0,0 +1,95 @@
+
+#ifndef LIBRARY_H_
+#define LIBRARY_H_
+
+
+#include "c_types.h"
+
+#include "util.h"
+
+
+#define IR_LIBRARY_MAGIC 0x4952424C
+#define IR_LIBRARY_SECTORS 2
+#define IR_LIBRARY_ENTRIES 48
+#define IR_LIBRARY_BUCKETS 16
+#define IR_LIBRARY_NAME_LENGTH_MAX 16
+
+#define IR_LIBRARY_ID_NONE 0
+
+#define IR_LIBRARY_STATE_ERASED 0xFFFFFFFF
+#define IR_LIBRARY_STATE_VALID 0x5555AAAA
+#define IR_LIBRARY_STATE_DELETED 0x00000000
+
+
+typedef enum ir_library_kind ir_library_kind_t;
+
+typedef struct ir_library_head ir_library_head_t;
+typedef struct ir_library_record ir_library_record_t;
+typedef struct ir_library_entry ir_library_entry_t;
+typedef struct ir_library ir_library_t;
+
+
+enum ir_library_kind {
+	IR_LIBRARY_SIGNAL,
+	IR_LIBRARY_SEQUENCE,
+	IR_LIBRARY_RULE
+};
+
+// flash layout, every field group is word aligned
+struct ir_library_head {
+	uint32_t magic;
+	uint32_t generation;
+};
+
+struct ir_library_record {
+	uint16_t id;
+	uint8_t kind;
+	uint8_t name_length;
+	uint16_t length;
+	uint16_t reserved;
+	uint32_t frequency;
+	uint32_t state;
+};
+
+struct ir_library_entry {
+	uint16_t id;
+	uint8_t kind;
+	uint8_t name_length;
+	uint16_t length;
+	uint16_t offset;
+	uint32_t frequency;
+	uint32_t hash;
+};
+
+struct ir_library {
+	uint32_t address;
+	uint8_t sector;
+	uint32_t generation;
+	uint16_t position;
+	uint16_t garbage;
+
+	ir_library_entry_t entries[IR_LIBRARY_ENTRIES];
+	uint8_t count;
+	int_table_t* ids;
+	int_table_t* names;
+};
+
+
+ir_library_t* ir_library_create(ir_library_t* library, uint32_t address);
+void ir_library_destroy(ir_library_t* library, bool all);
+bool ir_library_load(ir_library_t* library);
+bool ir_library_format(ir_library_t* library);
+
+ir_library_entry_t* ir_library_get(ir_library_t* library, uint16_t id);
+ir_library_entry_t* ir_library_find(ir_library_t* library, uint8_t* name, uint8_t name_length);
+bool ir_library_read(ir_library_t* library, ir_library_entry_t* entry, void* buffer);
+bool ir_library_read_name(ir_library_t* library, ir_library_entry_t* entry, uint8_t* name);
+bool ir_library_put(ir_library_t* library, uint16_t id, uint8_t kind, uint8_t* name, uint8_t name_length,
+		uint32_t frequency, void* data, uint16_t length);
+bool ir_library_delete(ir_library_t* library, uint16_t id);
+static inline uint16_t ir_library_padded(uint16_t length) {
+	return (length + 3) & ~3;
+}
+
+
+#endif /* LIBRARY_H_ */
@@ -0,0 +1,96 @@
+
+#include "limiter.h"
+
+#include "osapi.h"
+#include "user_interface.h"
+
+#include "memory.h"
+#include "util.h"
+
+#include "debug/debug_on.h"
+
+
+static ir_limiter_client_t* client_get(ir_limiter_t* limiter, uint8_t* ip, uint32_t now);
+static void refill(ir_limiter_t* limiter, ir_limiter_client_t* client, uint32_t now);
+
+
+ir_limiter_t* ICACHE_FLASH_ATTR ir_limiter_create(ir_limiter_t* limiter) {
+	if (limiter == NULL) limiter = (ir_limiter_t*) m_malloc(sizeof(ir_limiter_t));
+
+	m_memset(limiter, 0, sizeof(ir_limiter_t));
+	ir_limiter_configure(limiter, IR_LIMIT_CONNECT, IR_LIMIT_CONNECT_RATE, IR_LIMIT_CONNECT_BURST);
+	ir_limiter_configure(limiter, IR_LIMIT_SEND, IR_LIMIT_SEND_RATE, IR_LIMIT_SEND_BURST);
+	ir_limiter_configure(limiter, IR_LIMIT_OTHER, IR_LIMIT_OTHER_RATE, IR_LIMIT_OTHER_BURST);
+
+	return limiter;
+}
+
+void ICACHE_FLASH_ATTR ir_limiter_destroy(ir_limiter_t* limiter, bool all) {
+	if (all) m_free(limiter);
+}
+
+void ICACHE_FLASH_ATTR ir_limiter_configure(ir_limiter_t* limiter, ir_limit_class_t limit, uint16_t rate, uint16_t burst) {
+	if (limit >= IR_LIMIT_CLASSES) return;
+
+	// a rate of zero turns the limit off
+	limiter->limits[limit].rate = rate;
+	limiter->limits[limit].burst = MAX(burst, 1);
+}
+
+uint16_t ICACHE_FLASH_ATTR ir_limiter_take(ir_limiter_t* limiter, uint8_t* ip, ir_limit_class_t limit) {
+	if (limit >= IR_LIMIT_CLASSES) return 0;
+	uint16_t rate = limiter->limits[limit].rate;
+	if (rate <= 0) return 0;
+
+	uint32_t now = system_get_time();
+	ir_limiter_client_t* client = client_get(limiter, ip, now);
+	refill(limiter, client, now);
+
+	uint32_t* tokens = &client->tokens[limit];
+	if (*tokens >= IR_LIMITER_SCALE) {
+		*tokens -= IR_LIMITER_SCALE;
+		return 0;
+	}
+
+	// milliseconds until a whole token is back, rate thousandths come in per millisecond
+	limiter->stats.limited++;
+	uint32_t missing = IR_LIMITER_SCALE - *tokens;
+	return MAX((missing + rate - 1) / rate, 1);
+}
+
+static ir_limiter_client_t* ICACHE_FLASH_ATTR client_get(ir_limiter_t* limiter, uint8_t* ip, uint32_t now) {
+	ir_limiter_client_t* oldest = &limiter->clients[0];
+	uint8_t i = 0;
+	while (i < IR_LIMITER_CLIENTS) {
+		ir_limiter_client_t* client = &limiter->clients[i++];
+		if (client->used && array_equals(client->ip, ip, 4)) return client;
+		if (!client->used) oldest = client;
+		else if (oldest->used && ((int32_t) (client->refilled - oldest->refilled) < 0)) oldest = client;
+	}
+
+	// least recently seen client makes room, a new one starts with full buckets
+	if (oldest->used) limiter->stats.evicted++;
+	m_memcpy(oldest->ip, ip, 4);
+	oldest->used = true;
+	oldest->refilled = now;
+	i = 0;
+	while (i < IR_LIMIT_CLASSES) {
+		oldest->tokens[i] = limiter->limits[i].burst * IR_LIMITER_SCALE;
+		i++;
+	}
+	return oldest;
+}
+
+static void ICACHE_FLASH_ATTR refill(ir_limiter_t* limiter, ir_limiter_client_t* client, uint32_t now) {
+	uint32_t elapsed = now - client->refilled;
+	client->refilled = now;
+
+	uint8_t i = 0;
+	while (i < IR_LIMIT_CLASSES) {
+		ir_limit_t* limit = &limiter->limits[i];
+		uint32_t capacity = limit->burst * IR_LIMITER_SCALE;
+		uint64_t tokens = client->tokens[i] + (uint64_t) elapsed * limit->rate / 1000;
+		client->tokens[i] = MIN(tokens, capacity);
+		i++;
+	}
+}
@@ -0,0 +1,66 @@
+
+#ifndef LIMITER_H_
+#define LIMITER_H_
+
+
+#include "c_types.h"
+
+#include "util.h"
+
+
+#define IR_LIMITER_CLIENTS 8
+// tokens are kept in thousandths, a bucket refills rate tokens per second up to burst
+#define IR_LIMITER_SCALE 1000
+
+#define IR_LIMIT_CONNECT_RATE 2
+#define IR_LIMIT_CONNECT_BURST 10
+#define IR_LIMIT_SEND_RATE 10
+#define IR_LIMIT_SEND_BURST 20
+#define IR_LIMIT_OTHER_RATE 20
+#define IR_LIMIT_OTHER_BURST 40
+
+
+typedef enum ir_limit_class ir_limit_class_t;
+
+typedef struct ir_limit ir_limit_t;
+typedef struct ir_limiter_client ir_limiter_client_t;
+typedef struct ir_limiter ir_limiter_t;
+
+
+enum ir_limit_class {
+	IR_LIMIT_CONNECT,
+	IR_LIMIT_SEND,
+	IR_LIMIT_OTHER,
+	IR_LIMIT_CLASSES
+};
+
+struct ir_limit {
+	uint16_t rate;
+	uint16_t burst;
+};
+
+struct ir_limiter_client {
+	uint8_t ip[4];
+	uint32_t refilled;
+	uint32_t tokens[IR_LIMIT_CLASSES];
+	bool used;
+};
+
+struct ir_limiter {
+	ir_limit_t limits[IR_LIMIT_CLASSES];
+	ir_limiter_client_t clients[IR_LIMITER_CLIENTS];
+
+	struct {
+		uint32_t limited;
+		uint32_t evicted;
+	} stats;
+};
+
+
+ir_limiter_t* ir_limiter_create(ir_limiter_t* limiter);
+void ir_limiter_destroy(ir_limiter_t* limiter, bool all);
+void ir_limiter_configure(ir_limiter_t* limiter, ir_limit_class_t limit, uint16_t rate, uint16_t burst);
+uint16_t ir_limiter_take(ir_limiter_t* limiter, uint8_t* ip, ir_limit_class_t limit);
+
+
+#endif /* LIMITER_H_ */
@@ -27,5 +27,9 @@ static inline void m_memcpy(void* destination, const void* source, uint16_t leng
 	memcpy(destination, source, length);
 }
 
+static inline void m_memmove(void* destination, const void* source, uint16_t length) {
+	os_memmove(destination, source, length);
+}
+
 
 #endif /* USER_MEMORY_H_ */
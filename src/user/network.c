@@ -11,10 +11,14 @@
 #include "debug/debug_on.h"
 
 
-static bool is_station_connected();
+static void network_state_set(network_t* network, network_state_t state);
+static void network_deadline(network_t* network, uint16_t delay);
+static void network_backoff(network_t* network);
 
-static void network_configure_timer(network_t* network);
-static void network_check(network_t* network);
+static void network_handler(System_Event_t* event);
+static void network_retry(void* arg);
+static void network_timeout(void* arg);
+static void network_restore(void* arg);
 
 
 network_t* ICACHE_FLASH_ATTR network_get() {
@@ -22,24 +26,24 @@ network_t* ICACHE_FLASH_ATTR network_get() {
 	return &network;
 }
 
-static ICACHE_FLASH_ATTR void network_configure_timer(network_t* network) {
-	os_timer_disarm(&network->check_timer);
-	if (network->check & (network_mode_get(network) == STATION_MODE)) {
-		os_timer_setfn(&network->check_timer, network_check, network);
-		os_timer_arm(&network->check_timer, network->check_interval, true);
-	}
-}
-
 void ICACHE_FLASH_ATTR network_configure(network_t* network, bool autoconnect,
-		bool check, uint16_t check_interval, bool failover,
-		uint16_t failover_time) {
+		bool failover, uint16_t failover_time) {
 	network->autoconnect = autoconnect;
-	network->check = check;
-	network->check_interval = check_interval;
 	network->failover = failover;
 	network->failover_time = failover_time;
+	network->backoff = NETWORK_BACKOFF_MIN;
 
-	network_configure_timer(network);
+	os_timer_disarm(&network->failover_timer);
+	network->failover_armed = false;
+	os_timer_disarm(&network->backoff_timer);
+	os_timer_setfn(&network->backoff_timer, network_retry, network);
+
+	// reconnects are paced by the backoff here, not by the sdk
+	wifi_station_set_reconnect_policy(false);
+	wifi_set_event_handler_cb(network_handler);
+
+	network->state = NETWORK_CONNECTING;
+	network_deadline(network, failover_time);
 }
 
 bool ICACHE_FLASH_ATTR network_configure_station(network_t* network,
@@ -112,6 +116,8 @@ bool ICACHE_FLASH_ATTR network_configure_softap(network_t* network,
 }
 
 void ICACHE_FLASH_ATTR network_station_connect(network_t* network) {
+	os_timer_disarm(&network->backoff_timer);
+	network->backoff = NETWORK_BACKOFF_MIN;
 	wifi_station_connect();
 }
 
@@ -145,8 +151,6 @@ bool ICACHE_FLASH_ATTR network_mode_set(network_t* network, uint8_t mode) {
 		break;
 	}
 
-	network_configure_timer(network);
-
 	return result;
 }
 
@@ -154,52 +158,130 @@ uint8_t ICACHE_FLASH_ATTR network_mode_get(network_t* network) {
 	return wifi_get_opmode();
 }
 
-static void ICACHE_FLASH_ATTR network_check(network_t* network) {
-	if (network_mode_get(network) == SOFTAP_MODE) {
-		DEBUG_FUNCTION("illegal state");
+void ICACHE_FLASH_ATTR network_event(network_t* network,
+		network_event_t event, uint8_t reason) {
+	DEBUG("network event %d state %d reason %d", event, network->state, reason);
+
+	switch (event) {
+	case NETWORK_EVENT_CONNECTED:
+		if (network->state == NETWORK_CONNECTING) {
+			network_state_set(network, NETWORK_ASSOCIATED);
+		}
+		break;
+	case NETWORK_EVENT_GOT_IP:
+		os_timer_disarm(&network->backoff_timer);
+		network->backoff = NETWORK_BACKOFF_MIN;
+		os_timer_disarm(&network->failover_timer);
+		network->failover_armed = false;
+
+		if (network->state == NETWORK_FAILOVER) {
+			// the soft ap is dropped outside of the sdk callback
+			os_timer_setfn(&network->failover_timer, network_restore, network);
+			os_timer_arm(&network->failover_timer, 0, false);
+		}
+		network_state_set(network, NETWORK_CONNECTED);
+		break;
+	case NETWORK_EVENT_DISCONNECTED:
+		network->reason = reason;
+		if (network->state != NETWORK_FAILOVER) {
+			network_state_set(network, NETWORK_CONNECTING);
+
+			// wrong credentials do not get better by waiting, but the soft ap
+			// is still raised outside of the sdk callback
+			if ((reason == REASON_AUTH_FAIL)
+					|| (reason == REASON_4WAY_HANDSHAKE_TIMEOUT)) {
+				network->failover_armed = false;
+				network_deadline(network, 0);
+			} else {
+				network_deadline(network, network->failover_time);
+			}
+		}
+		network_backoff(network);
+		break;
+	case NETWORK_EVENT_DHCP_TIMEOUT:
+		wifi_station_dhcpc_stop();
+		wifi_station_dhcpc_start();
+		break;
+	case NETWORK_EVENT_FAILOVER_TIMEOUT:
+		os_timer_disarm(&network->failover_timer);
+		network->failover_armed = false;
+		if (!network->failover) break;
+		if ((network->state == NETWORK_CONNECTED)
+				|| (network->state == NETWORK_FAILOVER)) {
+			break;
+		}
+
+		network_state_set(network, NETWORK_FAILOVER);
+		network_mode_set(network, STATIONAP_MODE);
+		break;
+	}
+}
+
+static void ICACHE_FLASH_ATTR network_state_set(network_t* network,
+		network_state_t state) {
+	if (network->state == state)
 		return;
+
+	network->state = state;
+	if (network->state_cb != NULL) {
+		network->state_cb(network, state);
 	}
+}
 
-	bool connected = is_station_connected();
+static void ICACHE_FLASH_ATTR network_deadline(network_t* network,
+		uint16_t delay) {
+	if (!network->failover || network->failover_armed)
+		return;
 
-	switch (network->state) {
-	case NETWORK_FAILOVER:
-	case NETWORK_CONNECTING:
-		if (connected) {
-			if (network->state == NETWORK_FAILOVER) {
-				network_mode_set(network, STATION_MODE);
-			}
+	os_timer_disarm(&network->failover_timer);
+	os_timer_setfn(&network->failover_timer, network_timeout, network);
+	os_timer_arm(&network->failover_timer, delay, false);
+	network->failover_armed = true;
+}
 
-			network->state = NETWORK_CONNECTED;
-		} else {
-			if (wifi_station_dhcpc_status() == DHCP_STOPPED) {
-				wifi_station_dhcpc_start();
-			}
+static void ICACHE_FLASH_ATTR network_backoff(network_t* network) {
+	os_timer_disarm(&network->backoff_timer);
+	os_timer_arm(&network->backoff_timer, network->backoff, false);
+	network->backoff = MIN((uint32_t) network->backoff * 2, NETWORK_BACKOFF_MAX);
+}
 
-			if (network->state != NETWORK_FAILOVER) {
-				if (network->failover_start == 0) {
-					network->failover_start = system_get_time();
-				}
-
-				uint16 time = (system_get_time() - network->failover_start)
-						/ 1000;
-				if (time >= network->failover_time) {
-					network->failover_start = 0;
-					network_mode_set(network, STATIONAP_MODE);
-				}
-			}
-		}
+static void ICACHE_FLASH_ATTR network_handler(System_Event_t* event) {
+	network_t* network = network_get();
+
+	switch (event->event) {
+	case EVENT_STAMODE_CONNECTED:
+		network_event(network, NETWORK_EVENT_CONNECTED, 0);
 		break;
-	case NETWORK_CONNECTED:
-		if (!connected) {
-			network->state = NETWORK_CONNECTING;
-		}
+	case EVENT_STAMODE_GOT_IP:
+		network_event(network, NETWORK_EVENT_GOT_IP, 0);
+		break;
+	case EVENT_STAMODE_DISCONNECTED:
+		network_event(network, NETWORK_EVENT_DISCONNECTED,
+				event->event_info.disconnected.reason);
+		break;
+	case EVENT_STAMODE_DHCP_TIMEOUT:
+		network_event(network, NETWORK_EVENT_DHCP_TIMEOUT, 0);
 		break;
 	}
 }
 
-static bool ICACHE_FLASH_ATTR is_station_connected() {
-	ip_info_t info;
-	wifi_get_ip_info(STATION_IF, &info);
-	return info.ip.addr | info.netmask.addr | info.gw.addr;
+static void ICACHE_FLASH_ATTR network_retry(void* arg) {
+	network_t* network = (network_t*) arg;
+	if (network->state == NETWORK_CONNECTED)
+		return;
+
+	wifi_station_connect();
+}
+
+static void ICACHE_FLASH_ATTR network_timeout(void* arg) {
+	network_t* network = (network_t*) arg;
+	network->failover_armed = false;
+	network_event(network, NETWORK_EVENT_FAILOVER_TIMEOUT, network->reason);
+}
+
+static void ICACHE_FLASH_ATTR network_restore(void* arg) {
+	network_t* network = (network_t*) arg;
+	if (network->state == NETWORK_CONNECTED) {
+		network_mode_set(network, STATION_MODE);
+	}
 }
@@ -10,6 +10,10 @@
 #include "util.h"
 
 
+#define NETWORK_BACKOFF_MIN 500
+#define NETWORK_BACKOFF_MAX 30000
+
+
 typedef struct station_config station_config_t;
 typedef struct softap_config softap_config_t;
 typedef struct ip_info ip_info_t;
@@ -17,34 +21,50 @@ typedef struct ip_info ip_info_t;
 typedef struct network network_t;
 
 typedef enum network_state network_state_t;
+typedef enum network_event network_event_t;
+
+typedef void (*network_state_cb_t)(network_t* network, network_state_t state);
 
 
 enum network_state {
 	NETWORK_CONNECTING,
+	NETWORK_ASSOCIATED,
 	NETWORK_CONNECTED,
 	NETWORK_FAILOVER
 };
 
+enum network_event {
+	NETWORK_EVENT_CONNECTED,
+	NETWORK_EVENT_GOT_IP,
+	NETWORK_EVENT_DISCONNECTED,
+	NETWORK_EVENT_DHCP_TIMEOUT,
+	NETWORK_EVENT_FAILOVER_TIMEOUT
+};
+
 struct network {
 	bool autoconnect;
-	bool check;
-	uint16_t check_interval;
-	os_timer_t check_timer;
 	bool failover;
 	uint16_t failover_time;
+	// one timer for the failover deadline and for leaving failover again
+	os_timer_t failover_timer;
+	bool failover_armed;
+	uint16_t backoff;
+	os_timer_t backoff_timer;
 
 	station_config_t station_config;
 	softap_config_t softap_config;
 
 	network_state_t state;
-	uint32_t failover_start;
+	uint8_t reason;
+
+	network_state_cb_t state_cb;
+	void* reverse;
 };
 
 
 network_t* ICACHE_FLASH_ATTR network_get();
 
-void network_configure(network_t* network, bool autoconnect, bool check, uint16_t check_interval,
-		bool failover, uint16_t failover_time);
+void network_configure(network_t* network, bool autoconnect, bool failover, uint16_t failover_time);
 bool network_configure_station(network_t* network, string_t* ssid, string_t* password, uint8_t* bssid);
 bool network_configure_softap(network_t* network, string_t* ssid, string_t* password, uint8_t channel,
 		AUTH_MODE authmode, bool hidden, uint8_t max_connection, uint16_t beacon_interval);
@@ -52,6 +72,7 @@ void network_station_connect(network_t* network);
 void network_station_disconnect(network_t* network);
 bool network_mode_set(network_t* network, uint8_t mode);
 uint8_t network_mode_get(network_t* network);
+void network_event(network_t* network, network_event_t event, uint8_t reason);
 
 
 #endif /* USER_NETWORK_H_ */
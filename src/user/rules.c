@@ -0,0 +1,257 @@
+
+#include "rules.h"
+
+#include "osapi.h"
+#include "os_type.h"
+
+#include "memory.h"
+#include "util.h"
+
+#include "debug/debug_on.h"
+
+
+#define NEC_LEAD_MARK 9000
+#define NEC_LEAD_SPACE 4500
+#define NEC_BIT_MARK 560
+#define NEC_ZERO_SPACE 560
+#define NEC_ONE_SPACE 1690
+#define NEC_BITS 32
+
+
+static uint8_t compare(uint16_t old, uint16_t new);
+static bool near(uint16_t time, uint16_t expected);
+
+static void idle(ir_rules_t* rules);
+static void received(signal_station_t* station);
+static void evaluate(void* arg);
+static bool fire(ir_rules_t* rules, ir_rule_t* rule, uint32_t key);
+
+
+// 0 shorter, 1 about the same, 2 longer; tolerant to the jitter of the receiver
+static uint8_t ICACHE_FLASH_ATTR compare(uint16_t old, uint16_t new) {
+	if ((uint32_t) new * 10 < (uint32_t) old * 8) return 0;
+	if ((uint32_t) old * 10 < (uint32_t) new * 8) return 2;
+	return 1;
+}
+
+static bool ICACHE_FLASH_ATTR near(uint16_t time, uint16_t expected) {
+	return ((uint32_t) time * 4 >= (uint32_t) expected * 3) && ((uint32_t) time * 4 <= (uint32_t) expected * 5);
+}
+
+uint32_t ICACHE_FLASH_ATTR ir_rules_fingerprint(uint16_t* times, uint16_t count) {
+	// fnv-1a over marks compared to marks and spaces compared to spaces
+	uint32_t hash = 2166136261;
+	uint16_t i = 0;
+	while (i + 2 < count) {
+		hash ^= compare(times[i], times[i + 2]);
+		hash *= 16777619;
+		i++;
+	}
+	return hash;
+}
+
+bool ICACHE_FLASH_ATTR ir_rules_decode_nec(uint16_t* times, uint16_t count, uint32_t* code) {
+	if (count < 2 + 2 * NEC_BITS + 1) return false;
+	if (!near(times[0], NEC_LEAD_MARK)) return false;
+	if (!near(times[1], NEC_LEAD_SPACE)) return false;
+
+	uint32_t result = 0;
+	uint8_t i = 0;
+	while (i < NEC_BITS) {
+		uint16_t mark = times[2 + 2 * i];
+		uint16_t space = times[3 + 2 * i];
+		if (!near(mark, NEC_BIT_MARK)) return false;
+		if (near(space, NEC_ONE_SPACE)) result |= 1UL << i;
+		else if (!near(space, NEC_ZERO_SPACE)) return false;
+		i++;
+	}
+
+	*code = result;
+	return true;
+}
+
+ir_rules_t* ICACHE_FLASH_ATTR ir_rules_create(ir_rules_t* rules, signal_station_t* station, uint8_t gpio, ir_scheduler_t* scheduler,
+		ir_library_t* library, ir_sequencer_t* sequencer) {
+	if (rules == NULL) rules = (ir_rules_t*) m_malloc(sizeof(ir_rules_t));
+
+	m_memset(rules, 0, sizeof(ir_rules_t));
+	rules->station = station;
+	rules->gpio = gpio;
+	rules->scheduler = scheduler;
+	rules->library = library;
+	rules->sequencer = sequencer;
+
+	stack_buffer_create(&rules->times, NULL, IR_RULES_TIMES * IR_RULES_TIME_LENGTH);
+
+	os_timer_disarm(&rules->timer);
+	os_timer_setfn(&rules->timer, evaluate, rules);
+
+	return rules;
+}
+
+void ICACHE_FLASH_ATTR ir_rules_destroy(ir_rules_t* rules, bool all) {
+	ir_rules_stop(rules);
+	stack_buffer_destroy(&rules->times, false);
+
+	if (all) m_free(rules);
+}
+
+void ICACHE_FLASH_ATTR ir_rules_load(ir_rules_t* rules) {
+	DEBUG_FUNCTION_START();
+
+	ir_library_t* library = rules->library;
+	rules->count = 0;
+
+	uint8_t i = 0;
+	while ((i < IR_LIBRARY_ENTRIES) && (rules->count < IR_RULES_MAX)) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+		if (entry->kind != IR_LIBRARY_RULE) continue;
+		if (entry->length != sizeof(ir_rule_t)) continue;
+
+		ir_rule_t* rule = &rules->rules[rules->count];
+		if (!ir_library_read(library, entry, rule)) continue;
+		rule->id = entry->id;
+		rules->count++;
+	}
+	DEBUG("rules %d", rules->count);
+
+	idle(rules);
+	ir_rules_listen(rules);
+}
+
+void ICACHE_FLASH_ATTR ir_rules_watch(ir_rules_t* rules, bool watch) {
+	if (watch) {
+		rules->watchers++;
+		ir_rules_listen(rules);
+	} else if (rules->watchers > 0) {
+		rules->watchers--;
+		idle(rules);
+	}
+}
+
+static void ICACHE_FLASH_ATTR idle(ir_rules_t* rules) {
+	// nothing to match against and nobody watching, the receiver is left alone
+	signal_station_t* station = rules->station;
+	if ((rules->count <= 0) && (rules->watchers <= 0) && station->receiving && (station->reverse == rules)) {
+		signal_station_reset(station);
+	}
+}
+
+void ICACHE_FLASH_ATTR ir_rules_start(ir_rules_t* rules) {
+	rules->running = true;
+	ir_rules_listen(rules);
+}
+
+void ICACHE_FLASH_ATTR ir_rules_stop(ir_rules_t* rules) {
+	rules->running = false;
+	os_timer_disarm(&rules->timer);
+
+	signal_station_t* station = rules->station;
+	if (station->receiving && (station->reverse == rules)) signal_station_reset(station);
+}
+
+void ICACHE_FLASH_ATTR ir_rules_listen(ir_rules_t* rules) {
+	if (!rules->running) return;
+	if ((rules->count <= 0) && (rules->watchers <= 0)) return;
+
+	// a client capture has the receiver, listening continues once it is done
+	signal_station_t* station = rules->station;
+	if (station->receiving) return;
+	if (ir_scheduler_held(rules->scheduler)) return;
+
+	stack_buffer_reset(&rules->times);
+	station->gpio = rules->gpio;
+	station->times = &rules->times;
+	station->reverse = rules;
+	station->received_cb = received;
+	signal_receive_next(station);
+}
+
+static void received(signal_station_t* station) {
+	ir_rules_t* rules = (ir_rules_t*) station->reverse;
+	// leave the interrupt before touching flash or the scheduler
+	os_timer_disarm(&rules->timer);
+	os_timer_arm(&rules->timer, 0, false);
+}
+
+static void ICACHE_FLASH_ATTR evaluate(void* arg) {
+	ir_rules_t* rules = (ir_rules_t*) arg;
+	uint16_t* times = (uint16_t*) rules->times.start;
+	uint16_t count = stack_buffer_size(&rules->times) / IR_RULES_TIME_LENGTH;
+	rules->stats.captures++;
+
+	uint32_t fingerprint = ir_rules_fingerprint(times, count);
+	uint32_t code = 0;
+	bool nec = ir_rules_decode_nec(times, count, &code);
+	DEBUG("capture %d times, fingerprint %x", count, fingerprint);
+
+	uint8_t i = 0;
+	while (i < rules->count) {
+		ir_rule_t* rule = &rules->rules[i++];
+		bool match = false;
+		switch (rule->match) {
+		case IR_RULE_FINGERPRINT:
+			match = rule->key == fingerprint;
+			break;
+		case IR_RULE_NEC:
+			match = nec && (rule->key == code);
+			break;
+		}
+		if (!match) continue;
+
+		rules->stats.matches++;
+		if (!fire(rules, rule, (rule->match == IR_RULE_NEC) ? code : fingerprint)) rules->stats.failed++;
+	}
+	if (rules->capture_cb != NULL) rules->capture_cb(rules, times, count, fingerprint, nec, code);
+
+	stack_buffer_reset(&rules->times);
+	ir_rules_listen(rules);
+}
+
+static bool ICACHE_FLASH_ATTR fire(ir_rules_t* rules, ir_rule_t* rule, uint32_t key) {
+	DEBUG("rule %d action %d", rule->id, rule->action);
+
+	switch (rule->action) {
+	case IR_RULE_SEND:
+	{
+		ir_library_entry_t* entry = ir_library_get(rules->library, rule->target);
+		if ((entry == NULL) || (entry->kind != IR_LIBRARY_SIGNAL)) return false;
+
+		ir_job_t job;
+		m_memset(&job, 0, sizeof(job));
+		job.priority = IR_PRIORITY_INTERACTIVE;
+		job.client = IR_RULES_CLIENT;
+		job.tag = rule->id;
+		job.frequency = entry->frequency;
+		job.repeat = rule->repeat;
+		job.gpio = rule->gpio;
+		job.owned = true;
+
+		stack_buffer_create(&job.times, NULL, entry->length);
+		if ((entry->length > 0) && (job.times.start == NULL)) return false;
+		if (!ir_library_read(rules->library, entry, job.times.start)) {
+			stack_buffer_destroy(&job.times, false);
+			return false;
+		}
+		stack_buffer_skip(&job.times, entry->length);
+
+		if (!ir_scheduler_submit(rules->scheduler, &job)) {
+			stack_buffer_destroy(&job.times, false);
+			return false;
+		}
+		return true;
+	}
+	case IR_RULE_SEQUENCE:
+	{
+		ir_library_entry_t* entry = ir_library_get(rules->library, rule->target);
+		if (entry == NULL) return false;
+		return ir_sequencer_run(rules->sequencer, entry, IR_SCHEDULER_CLIENT_NONE, rule->id);
+	}
+	case IR_RULE_NOTIFY:
+		if (rules->notify_cb != NULL) rules->notify_cb(rules, rule, key);
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,93 @@
+
+#ifndef RULES_H_
+#define RULES_H_
+
+
+#include "c_types.h"
+#include "os_type.h"
+
+#include "util.h"
+#include "signal.h"
+#include "scheduler.h"
+#include "library.h"
+#include "sequence.h"
+
+
+#define IR_RULES_CLIENT 0xFFFD
+#define IR_RULES_MAX 16
+#define IR_RULES_TIMES 256
+#define IR_RULES_TIME_LENGTH 2
+
+
+typedef enum ir_rule_match ir_rule_match_t;
+typedef enum ir_rule_action ir_rule_action_t;
+
+typedef struct ir_rule ir_rule_t;
+typedef struct ir_rules ir_rules_t;
+
+typedef void (*ir_rule_notify_cb_t) (ir_rules_t* rules, ir_rule_t* rule, uint32_t key);
+typedef void (*ir_rules_capture_cb_t) (ir_rules_t* rules, uint16_t* times, uint16_t count, uint32_t fingerprint, bool nec, uint32_t code);
+
+
+enum ir_rule_match {
+	IR_RULE_FINGERPRINT,
+	IR_RULE_NEC
+};
+
+enum ir_rule_action {
+	IR_RULE_SEND,
+	IR_RULE_SEQUENCE,
+	IR_RULE_NOTIFY
+};
+
+// stored in the library as they are, id is filled in when loaded
+struct ir_rule {
+	uint32_t key;
+	uint8_t match;
+	uint8_t action;
+	uint8_t gpio;
+	uint8_t repeat;
+	uint16_t target;
+	uint16_t id;
+};
+
+struct ir_rules {
+	signal_station_t* station;
+	uint8_t gpio;
+	ir_scheduler_t* scheduler;
+	ir_library_t* library;
+	ir_sequencer_t* sequencer;
+
+	ir_rule_t rules[IR_RULES_MAX];
+	uint8_t count;
+	uint8_t watchers;
+
+	stack_buffer_t times;
+	bool running;
+	os_timer_t timer;
+
+	struct {
+		uint32_t captures;
+		uint32_t matches;
+		uint32_t failed;
+	} stats;
+
+	void* reverse;
+	ir_rule_notify_cb_t notify_cb;
+	ir_rules_capture_cb_t capture_cb;
+};
+
+
+ir_rules_t* ir_rules_create(ir_rules_t* rules, signal_station_t* station, uint8_t gpio, ir_scheduler_t* scheduler,
+		ir_library_t* library, ir_sequencer_t* sequencer);
+void ir_rules_destroy(ir_rules_t* rules, bool all);
+void ir_rules_load(ir_rules_t* rules);
+void ir_rules_start(ir_rules_t* rules);
+void ir_rules_stop(ir_rules_t* rules);
+void ir_rules_listen(ir_rules_t* rules);
+void ir_rules_watch(ir_rules_t* rules, bool watch);
+uint32_t ir_rules_fingerprint(uint16_t* times, uint16_t count);
+bool ir_rules_decode_nec(uint16_t* times, uint16_t count, uint32_t* code);
+
+
+#endif /* RULES_H_ */
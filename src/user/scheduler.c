@@ -0,0 +1,358 @@
+
+#include "scheduler.h"
+
+#include "osapi.h"
+#include "os_type.h"
+
+#include "memory.h"
+#include "util.h"
+
+#include "debug/debug_on.h"
+
+
+static bool job_before(ir_job_t* a, ir_job_t* b);
+static void heap_up(ir_scheduler_t* scheduler, uint8_t i);
+static void heap_down(ir_scheduler_t* scheduler, uint8_t i);
+static ir_job_t* heap_poll(ir_scheduler_t* scheduler);
+
+static void job_finish(ir_scheduler_t* scheduler, ir_job_t* job, ir_job_result_t result);
+static void job_fire(ir_scheduler_t* scheduler, ir_job_t* job);
+
+static void queue(ir_scheduler_t* scheduler, ir_job_t* job);
+static uint8_t cancel(ir_scheduler_t* scheduler, bool all, uint16_t client, uint16_t tag, bool tagged);
+static bool cancel_matches(ir_job_t* job, uint16_t client, uint16_t tag, bool tagged);
+static void schedule(ir_scheduler_t* scheduler, uint16_t delay);
+static void run(void* arg);
+
+static ir_job_t* next_at(ir_scheduler_t* scheduler);
+static void schedule_at(ir_scheduler_t* scheduler);
+static void run_at(void* arg);
+static void clock_refresh(void* arg);
+
+
+static bool job_before(ir_job_t* a, ir_job_t* b) {
+	if (a->priority != b->priority) return a->priority < b->priority;
+	return (int32_t) (a->sequence - b->sequence) < 0;
+}
+
+static void ICACHE_FLASH_ATTR heap_up(ir_scheduler_t* scheduler, uint8_t i) {
+	ir_job_t** heap = scheduler->heap;
+	while (i > 0) {
+		uint8_t parent = (i - 1) >> 1;
+		if (!job_before(heap[i], heap[parent])) break;
+		ir_job_t* tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+static void ICACHE_FLASH_ATTR heap_down(ir_scheduler_t* scheduler, uint8_t i) {
+	ir_job_t** heap = scheduler->heap;
+	while (true) {
+		uint8_t first = i;
+		uint8_t left = 2 * i + 1;
+		uint8_t right = left + 1;
+		if ((left < scheduler->size) && job_before(heap[left], heap[first])) first = left;
+		if ((right < scheduler->size) && job_before(heap[right], heap[first])) first = right;
+		if (first == i) break;
+		ir_job_t* tmp = heap[i];
+		heap[i] = heap[first];
+		heap[first] = tmp;
+		i = first;
+	}
+}
+
+static ir_job_t* ICACHE_FLASH_ATTR heap_poll(ir_scheduler_t* scheduler) {
+	if (scheduler->size == 0) return NULL;
+
+	ir_job_t* result = scheduler->heap[0];
+	scheduler->size--;
+	scheduler->heap[0] = scheduler->heap[scheduler->size];
+	heap_down(scheduler, 0);
+	return result;
+}
+
+ir_scheduler_t* ICACHE_FLASH_ATTR ir_scheduler_create(ir_scheduler_t* scheduler, signal_station_t* station, uint8_t gpio) {
+	if (scheduler == NULL) scheduler = (ir_scheduler_t*) m_malloc(sizeof(ir_scheduler_t));
+
+	m_memset(scheduler, 0, sizeof(ir_scheduler_t));
+	scheduler->station = station;
+	scheduler->gpio = gpio;
+
+	os_timer_disarm(&scheduler->timer);
+	os_timer_setfn(&scheduler->timer, run, scheduler);
+	os_timer_disarm(&scheduler->at_timer);
+	os_timer_setfn(&scheduler->at_timer, run_at, scheduler);
+
+	// the system time wraps every 71 minutes, a wrap must be seen before the next one
+	scheduler->clock_last = system_get_time();
+	os_timer_disarm(&scheduler->clock_timer);
+	os_timer_setfn(&scheduler->clock_timer, clock_refresh, scheduler);
+	os_timer_arm(&scheduler->clock_timer, IR_SCHEDULER_CLOCK_REFRESH, true);
+
+	return scheduler;
+}
+
+void ICACHE_FLASH_ATTR ir_scheduler_destroy(ir_scheduler_t* scheduler, bool all) {
+	os_timer_disarm(&scheduler->timer);
+	os_timer_disarm(&scheduler->at_timer);
+	os_timer_disarm(&scheduler->clock_timer);
+	ir_scheduler_cancel_all(scheduler);
+
+	if (all) m_free(scheduler);
+}
+
+bool ICACHE_FLASH_ATTR ir_scheduler_submit(ir_scheduler_t* scheduler, ir_job_t* job) {
+	ir_job_t* slot = NULL;
+	uint8_t i = 0;
+	while (i < IR_SCHEDULER_JOBS) {
+		if (!scheduler->jobs[i].used) {
+			slot = &scheduler->jobs[i];
+			break;
+		}
+		i++;
+	}
+	if (slot == NULL) {
+		DEBUG_FUNCTION("queue full");
+		scheduler->stats.rejected++;
+		return false;
+	}
+
+	*slot = *job;
+	slot->used = true;
+	slot->submitted = system_get_time();
+	slot->sequence = scheduler->sequence++;
+	if (slot->repeat == 0) slot->repeat = 1;
+	scheduler->stats.submitted++;
+
+	if (slot->timed) {
+		schedule_at(scheduler);
+		return true;
+	}
+
+	queue(scheduler, slot);
+	if (!scheduler->armed && !ir_scheduler_held(scheduler)) schedule(scheduler, IR_SCHEDULER_DELAY);
+	return true;
+}
+
+static void ICACHE_FLASH_ATTR queue(ir_scheduler_t* scheduler, ir_job_t* job) {
+	scheduler->heap[scheduler->size] = job;
+	heap_up(scheduler, scheduler->size);
+	scheduler->size++;
+	scheduler->stats.depth_max = MAX(scheduler->stats.depth_max, scheduler->size);
+}
+
+uint8_t ICACHE_FLASH_ATTR ir_scheduler_cancel(ir_scheduler_t* scheduler, uint16_t client) {
+	// no client owns nothing, an idle connection must not take other jobs with it
+	if (client == IR_SCHEDULER_CLIENT_NONE) return 0;
+	return cancel(scheduler, false, client, 0, false);
+}
+
+uint8_t ICACHE_FLASH_ATTR ir_scheduler_cancel_tag(ir_scheduler_t* scheduler, uint16_t client, uint16_t tag) {
+	if (client == IR_SCHEDULER_CLIENT_NONE) return 0;
+	return cancel(scheduler, false, client, tag, true);
+}
+
+uint8_t ICACHE_FLASH_ATTR ir_scheduler_cancel_all(ir_scheduler_t* scheduler) {
+	return cancel(scheduler, true, IR_SCHEDULER_CLIENT_NONE, 0, false);
+}
+
+static bool ICACHE_FLASH_ATTR cancel_matches(ir_job_t* job, uint16_t client, uint16_t tag, bool tagged) {
+	if (job->client != client) return false;
+	return !tagged || (job->tag == tag);
+}
+
+static uint8_t ICACHE_FLASH_ATTR cancel(ir_scheduler_t* scheduler, bool all, uint16_t client, uint16_t tag, bool tagged) {
+	uint8_t result = 0;
+	uint8_t i = 0;
+	while (i < scheduler->size) {
+		ir_job_t* job = scheduler->heap[i];
+		if (!all && !cancel_matches(job, client, tag, tagged)) {
+			i++;
+			continue;
+		}
+		scheduler->size--;
+		scheduler->heap[i] = scheduler->heap[scheduler->size];
+		job_finish(scheduler, job, IR_JOB_CANCELLED);
+		result++;
+	}
+
+	// restore heap order after removals
+	i = scheduler->size >> 1;
+	while (i-- > 0) heap_down(scheduler, i);
+
+	i = 0;
+	while (i < IR_SCHEDULER_JOBS) {
+		ir_job_t* job = &scheduler->jobs[i++];
+		if (!job->used || !job->timed) continue;
+		if (!all && !cancel_matches(job, client, tag, tagged)) continue;
+		job_finish(scheduler, job, IR_JOB_CANCELLED);
+		result++;
+	}
+	schedule_at(scheduler);
+
+	return result;
+}
+
+bool ICACHE_FLASH_ATTR ir_scheduler_idle(ir_scheduler_t* scheduler) {
+	if ((scheduler->size > 0) || scheduler->armed || ir_scheduler_held(scheduler)) return false;
+	return next_at(scheduler) == NULL;
+}
+
+uint64_t ICACHE_FLASH_ATTR ir_scheduler_clock(ir_scheduler_t* scheduler) {
+	uint32_t now = system_get_time();
+	if (now < scheduler->clock_last) scheduler->clock_high++;
+	scheduler->clock_last = now;
+	return ((uint64_t) scheduler->clock_high << 32) | now;
+}
+
+static void ICACHE_FLASH_ATTR clock_refresh(void* arg) {
+	ir_scheduler_clock((ir_scheduler_t*) arg);
+}
+
+bool ICACHE_FLASH_ATTR ir_scheduler_hold(ir_scheduler_t* scheduler, uint16_t client) {
+	if (ir_scheduler_held(scheduler)) return false;
+
+	scheduler->holder = client;
+	os_timer_disarm(&scheduler->timer);
+	scheduler->armed = false;
+	return true;
+}
+
+void ICACHE_FLASH_ATTR ir_scheduler_unhold(ir_scheduler_t* scheduler, uint16_t client) {
+	if (scheduler->holder != client) return;
+
+	scheduler->holder = IR_SCHEDULER_CLIENT_NONE;
+	if (scheduler->size > 0) schedule(scheduler, IR_SCHEDULER_DELAY);
+}
+
+static void ICACHE_FLASH_ATTR job_finish(ir_scheduler_t* scheduler, ir_job_t* job, ir_job_result_t result) {
+	switch (result) {
+	case IR_JOB_SENT:
+		scheduler->stats.sent++;
+		break;
+	case IR_JOB_EXPIRED:
+		scheduler->stats.expired++;
+		break;
+	case IR_JOB_CANCELLED:
+		scheduler->stats.cancelled++;
+		break;
+	default:
+		break;
+	}
+
+	if (job->done_cb != NULL) job->done_cb(job, result);
+	if (job->owned) stack_buffer_destroy(&job->times, false);
+	job->used = false;
+}
+
+static void ICACHE_FLASH_ATTR job_fire(ir_scheduler_t* scheduler, ir_job_t* job) {
+	signal_station_t* station = scheduler->station;
+
+	// borrow the station, a pending receive is suspended and armed again afterwards
+	signal_station_t saved = *station;
+	signal_station_reset(station);
+
+	// 0 keeps the scheduler pin
+	station->gpio = (job->gpio != 0) ? job->gpio : scheduler->gpio;
+	station->frequency = job->frequency;
+	station->times = &job->times;
+
+	uint32_t start = system_get_time();
+	uint8_t i = 0;
+	while (i++ < job->repeat) {
+		signal_send(station);
+	}
+	scheduler->stats.airtime += system_get_time() - start;
+
+	*station = saved;
+	if (saved.receiving) signal_receive_next(station);
+}
+
+static void ICACHE_FLASH_ATTR schedule(ir_scheduler_t* scheduler, uint16_t delay) {
+	os_timer_disarm(&scheduler->timer);
+	os_timer_arm(&scheduler->timer, delay, false);
+	scheduler->armed = true;
+}
+
+static void ICACHE_FLASH_ATTR run(void* arg) {
+	ir_scheduler_t* scheduler = (ir_scheduler_t*) arg;
+	scheduler->armed = false;
+	if (ir_scheduler_held(scheduler)) return;
+
+	while (true) {
+		ir_job_t* job = heap_poll(scheduler);
+		if (job == NULL) return;
+
+		uint32_t now = system_get_time();
+		if ((job->deadline != 0) && ((int32_t) (now - job->deadline) > 0)) {
+			DEBUG_FUNCTION("job expired");
+			job_finish(scheduler, job, IR_JOB_EXPIRED);
+			continue;
+		}
+
+		uint32_t wait = now - job->submitted;
+		scheduler->stats.wait_total += wait;
+		scheduler->stats.wait_max = MAX(scheduler->stats.wait_max, wait);
+
+		uint16_t delay = job->delay;
+		job_fire(scheduler, job);
+		job_finish(scheduler, job, IR_JOB_SENT);
+
+		// one job per timer run, the event loop gets a turn in between
+		if ((scheduler->size > 0) || (delay > 0)) schedule(scheduler, delay);
+		return;
+	}
+}
+
+static ir_job_t* ICACHE_FLASH_ATTR next_at(ir_scheduler_t* scheduler) {
+	ir_job_t* result = NULL;
+	uint8_t i = 0;
+	while (i < IR_SCHEDULER_JOBS) {
+		ir_job_t* job = &scheduler->jobs[i++];
+		if (!job->used || !job->timed) continue;
+		if ((result == NULL) || ((int32_t) (job->at - result->at) < 0)) result = job;
+	}
+	return result;
+}
+
+static void ICACHE_FLASH_ATTR schedule_at(ir_scheduler_t* scheduler) {
+	os_timer_disarm(&scheduler->at_timer);
+	ir_job_t* job = next_at(scheduler);
+	if (job == NULL) return;
+
+	// the timer only has milliseconds, it wakes up early and the rest is waited out
+	int32_t wait = job->at - system_get_time() - IR_SCHEDULER_AT_MARGIN;
+	os_timer_arm(&scheduler->at_timer, (wait > 0) ? wait / 1000 : 0, false);
+}
+
+static void ICACHE_FLASH_ATTR run_at(void* arg) {
+	ir_scheduler_t* scheduler = (ir_scheduler_t*) arg;
+	ir_job_t* job = next_at(scheduler);
+	if (job == NULL) return;
+
+	int32_t wait = job->at - system_get_time();
+	if (wait > IR_SCHEDULER_AT_MARGIN) {
+		schedule_at(scheduler);
+		return;
+	}
+	if (ir_scheduler_held(scheduler)) {
+		// a stream has the transmitter, the job waits in the queue like any other
+		job->timed = false;
+		queue(scheduler, job);
+		schedule_at(scheduler);
+		return;
+	}
+
+	if (wait > 0) os_delay_us(wait);
+	uint32_t now = system_get_time();
+	if ((job->deadline != 0) && ((int32_t) (now - job->deadline) > 0)) {
+		DEBUG_FUNCTION("job expired");
+		job_finish(scheduler, job, IR_JOB_EXPIRED);
+	} else {
+		job_fire(scheduler, job);
+		job_finish(scheduler, job, IR_JOB_SENT);
+	}
+	schedule_at(scheduler);
+}
@@ -0,0 +1,120 @@
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+
+#include "c_types.h"
+#include "os_type.h"
+
+#include "util.h"
+#include "signal.h"
+
+
+#define IR_SCHEDULER_JOBS 16
+#define IR_SCHEDULER_DELAY 0
+
+#define IR_SCHEDULER_AT_MARGIN 2000
+#define IR_SCHEDULER_CLOCK_REFRESH 60000
+
+#define IR_SCHEDULER_CLIENT_NONE 0
+#define IR_SCHEDULER_CLIENT_RESERVED 0xFFF0
+
+
+typedef enum ir_priority ir_priority_t;
+typedef enum ir_job_result ir_job_result_t;
+
+typedef struct ir_job ir_job_t;
+typedef struct ir_scheduler ir_scheduler_t;
+
+typedef void (*ir_job_done_cb_t) (ir_job_t* job, ir_job_result_t result);
+
+
+enum ir_priority {
+	IR_PRIORITY_INTERACTIVE,
+	IR_PRIORITY_NORMAL,
+	IR_PRIORITY_BULK
+};
+
+enum ir_job_result {
+	IR_JOB_SENT,
+	IR_JOB_EXPIRED,
+	IR_JOB_CANCELLED,
+	IR_JOB_REJECTED
+};
+
+struct ir_job {
+	uint8_t priority;
+	uint16_t client;
+	uint16_t tag;
+	uint32_t deadline;
+
+	uint32_t frequency;
+	stack_buffer_t times;
+	bool owned;
+	uint8_t gpio;
+	uint8_t repeat;
+	uint16_t delay;
+	// timed jobs skip the queue and fire at this system time
+	bool timed;
+	uint32_t at;
+
+	uint32_t submitted;
+	uint32_t sequence;
+	bool used;
+
+	void* reverse;
+	ir_job_done_cb_t done_cb;
+};
+
+struct ir_scheduler {
+	signal_station_t* station;
+	uint8_t gpio;
+
+	ir_job_t jobs[IR_SCHEDULER_JOBS];
+	ir_job_t* heap[IR_SCHEDULER_JOBS];
+	uint8_t size;
+	uint32_t sequence;
+
+	os_timer_t timer;
+	bool armed;
+	// a streamed transmit owns the transmitter, jobs wait until it is handed back
+	uint16_t holder;
+	os_timer_t at_timer;
+
+	os_timer_t clock_timer;
+	uint32_t clock_last;
+	uint32_t clock_high;
+
+	struct {
+		uint32_t submitted;
+		uint32_t rejected;
+		uint32_t sent;
+		uint32_t expired;
+		uint32_t cancelled;
+		uint8_t depth_max;
+		uint32_t wait_total;
+		uint32_t wait_max;
+		uint64_t airtime;
+	} stats;
+};
+
+
+ir_scheduler_t* ir_scheduler_create(ir_scheduler_t* scheduler, signal_station_t* station, uint8_t gpio);
+void ir_scheduler_destroy(ir_scheduler_t* scheduler, bool all);
+bool ir_scheduler_submit(ir_scheduler_t* scheduler, ir_job_t* job);
+uint8_t ir_scheduler_cancel(ir_scheduler_t* scheduler, uint16_t client);
+uint8_t ir_scheduler_cancel_tag(ir_scheduler_t* scheduler, uint16_t client, uint16_t tag);
+uint8_t ir_scheduler_cancel_all(ir_scheduler_t* scheduler);
+uint64_t ir_scheduler_clock(ir_scheduler_t* scheduler);
+bool ir_scheduler_idle(ir_scheduler_t* scheduler);
+bool ir_scheduler_hold(ir_scheduler_t* scheduler, uint16_t client);
+void ir_scheduler_unhold(ir_scheduler_t* scheduler, uint16_t client);
+static inline bool ir_scheduler_held(ir_scheduler_t* scheduler) {
+	return scheduler->holder != IR_SCHEDULER_CLIENT_NONE;
+}
+static inline uint8_t ir_scheduler_depth(ir_scheduler_t* scheduler) {
+	return scheduler->size;
+}
+
+
+#endif /* SCHEDULER_H_ */
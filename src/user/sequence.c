@@ -0,0 +1,136 @@
+
+#include "sequence.h"
+
+#include "osapi.h"
+#include "os_type.h"
+
+#include "memory.h"
+#include "util.h"
+
+#include "debug/debug_on.h"
+
+
+static void step(void* arg);
+static void step_done(ir_job_t* job, ir_job_result_t result);
+static void finish(ir_sequencer_t* sequencer, ir_job_result_t result);
+
+
+ir_sequencer_t* ICACHE_FLASH_ATTR ir_sequencer_create(ir_sequencer_t* sequencer, ir_scheduler_t* scheduler, ir_library_t* library) {
+	if (sequencer == NULL) sequencer = (ir_sequencer_t*) m_malloc(sizeof(ir_sequencer_t));
+
+	m_memset(sequencer, 0, sizeof(ir_sequencer_t));
+	sequencer->scheduler = scheduler;
+	sequencer->library = library;
+
+	os_timer_disarm(&sequencer->timer);
+	os_timer_setfn(&sequencer->timer, step, sequencer);
+
+	return sequencer;
+}
+
+void ICACHE_FLASH_ATTR ir_sequencer_destroy(ir_sequencer_t* sequencer, bool all) {
+	ir_sequencer_cancel(sequencer);
+
+	if (all) m_free(sequencer);
+}
+
+bool ICACHE_FLASH_ATTR ir_sequencer_run(ir_sequencer_t* sequencer, ir_library_entry_t* entry, uint16_t owner, uint16_t tag) {
+	DEBUG_FUNCTION_START();
+
+	if (sequencer->running) return false;
+	if (entry->kind != IR_LIBRARY_SEQUENCE) return false;
+	if (entry->length > sizeof(sequencer->steps)) return false;
+	if (!ir_library_read(sequencer->library, entry, sequencer->steps)) return false;
+
+	sequencer->count = entry->length / sizeof(ir_sequence_step_t);
+	sequencer->index = 0;
+	sequencer->owner = owner;
+	sequencer->tag = tag;
+	sequencer->running = true;
+
+	// steps never run inside the caller, the first one starts from the timer as well
+	os_timer_disarm(&sequencer->timer);
+	os_timer_arm(&sequencer->timer, 0, false);
+	return true;
+}
+
+bool ICACHE_FLASH_ATTR ir_sequencer_cancel(ir_sequencer_t* sequencer) {
+	if (!sequencer->running) return false;
+
+	sequencer->running = false;
+	os_timer_disarm(&sequencer->timer);
+	ir_scheduler_cancel(sequencer->scheduler, IR_SEQUENCER_CLIENT);
+	if (sequencer->progress_cb != NULL) sequencer->progress_cb(sequencer, IR_JOB_CANCELLED, true);
+
+	return true;
+}
+
+static void ICACHE_FLASH_ATTR step(void* arg) {
+	ir_sequencer_t* sequencer = (ir_sequencer_t*) arg;
+	if (!sequencer->running) return;
+
+	if (sequencer->index >= sequencer->count) {
+		finish(sequencer, IR_JOB_SENT);
+		return;
+	}
+
+	ir_sequence_step_t* s = &sequencer->steps[sequencer->index];
+	DEBUG("step %d/%d signal %d", sequencer->index, sequencer->count, s->id);
+	ir_library_entry_t* entry = ir_library_get(sequencer->library, s->id);
+	if ((entry == NULL) || (entry->kind != IR_LIBRARY_SIGNAL)) {
+		DEBUG_FUNCTION("signal missing");
+		finish(sequencer, IR_JOB_REJECTED);
+		return;
+	}
+
+	ir_job_t job;
+	m_memset(&job, 0, sizeof(job));
+	job.priority = IR_PRIORITY_BULK;
+	job.client = IR_SEQUENCER_CLIENT;
+	job.tag = sequencer->index;
+	job.frequency = entry->frequency;
+	job.repeat = s->repeat;
+	job.owned = true;
+	job.reverse = sequencer;
+	job.done_cb = step_done;
+
+	stack_buffer_create(&job.times, NULL, entry->length);
+	if ((entry->length > 0) && (job.times.start == NULL)) {
+		finish(sequencer, IR_JOB_REJECTED);
+		return;
+	}
+	if (!ir_library_read(sequencer->library, entry, job.times.start)) {
+		stack_buffer_destroy(&job.times, false);
+		finish(sequencer, IR_JOB_REJECTED);
+		return;
+	}
+	stack_buffer_skip(&job.times, entry->length);
+
+	if (!ir_scheduler_submit(sequencer->scheduler, &job)) {
+		stack_buffer_destroy(&job.times, false);
+		finish(sequencer, IR_JOB_REJECTED);
+	}
+}
+
+static void ICACHE_FLASH_ATTR step_done(ir_job_t* job, ir_job_result_t result) {
+	ir_sequencer_t* sequencer = (ir_sequencer_t*) job->reverse;
+	if (!sequencer->running) return;
+
+	if (result != IR_JOB_SENT) {
+		finish(sequencer, result);
+		return;
+	}
+
+	// the gap runs on our own timer, other clients can send in between
+	uint16_t delay = sequencer->steps[sequencer->index].delay;
+	sequencer->index++;
+	if (sequencer->progress_cb != NULL) sequencer->progress_cb(sequencer, result, false);
+	os_timer_disarm(&sequencer->timer);
+	os_timer_arm(&sequencer->timer, delay, false);
+}
+
+static void ICACHE_FLASH_ATTR finish(ir_sequencer_t* sequencer, ir_job_result_t result) {
+	sequencer->running = false;
+	os_timer_disarm(&sequencer->timer);
+	if (sequencer->progress_cb != NULL) sequencer->progress_cb(sequencer, result, true);
+}
@@ -0,0 +1,59 @@
+
+#ifndef SEQUENCE_H_
+#define SEQUENCE_H_
+
+
+#include "c_types.h"
+#include "os_type.h"
+
+#include "util.h"
+#include "scheduler.h"
+#include "library.h"
+
+
+#define IR_SEQUENCER_CLIENT 0xFFFE
+#define IR_SEQUENCE_STEPS_MAX 32
+
+
+typedef struct ir_sequence_step ir_sequence_step_t;
+typedef struct ir_sequencer ir_sequencer_t;
+
+typedef void (*ir_sequence_progress_cb_t) (ir_sequencer_t* sequencer, ir_job_result_t result, bool done);
+
+
+// stored in the library as they are, host byte order
+struct ir_sequence_step {
+	uint16_t id;
+	uint16_t delay;
+	uint8_t repeat;
+	uint8_t reserved;
+};
+
+struct ir_sequencer {
+	ir_scheduler_t* scheduler;
+	ir_library_t* library;
+
+	ir_sequence_step_t steps[IR_SEQUENCE_STEPS_MAX];
+	uint8_t count;
+	uint8_t index;
+	bool running;
+	os_timer_t timer;
+
+	uint16_t owner;
+	uint16_t tag;
+
+	void* reverse;
+	ir_sequence_progress_cb_t progress_cb;
+};
+
+
+ir_sequencer_t* ir_sequencer_create(ir_sequencer_t* sequencer, ir_scheduler_t* scheduler, ir_library_t* library);
+void ir_sequencer_destroy(ir_sequencer_t* sequencer, bool all);
+bool ir_sequencer_run(ir_sequencer_t* sequencer, ir_library_entry_t* entry, uint16_t owner, uint16_t tag);
+bool ir_sequencer_cancel(ir_sequencer_t* sequencer);
+static inline bool ir_sequencer_running(ir_sequencer_t* sequencer) {
+	return sequencer->running;
+}
+
+
+#endif /* SEQUENCE_H_ */
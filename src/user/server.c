@@ -14,25 +14,97 @@
 
 
 static void beacon_pack(ir_server_t* server);
+static void beacon_refresh(beacon_t* beacon);
+static uint8_t beacon_load(ir_server_t* server);
+static void beacon_patch(uint8_t* field, uint32_t value, uint8_t length);
 
 static void worker_stop(ir_worker_t* worker);
+static void worker_fail(ir_worker_t* worker, uint8_t status);
+static void worker_phase(ir_worker_t* worker, ir_phase_t phase);
+static void worker_state(ir_worker_t* worker, ir_worker_state_t state);
+static void worker_timeout(ir_worker_t* worker);
+static void worker_release(ir_worker_t* worker);
+static void worker_cancel(ir_worker_t* worker);
+static void worker_intercept(ir_worker_t* worker);
+static uint8_t cancel_queued(ir_worker_t* worker, bool targeted, uint16_t target);
 static void worker_run(ir_worker_t* worker);
 static void worker_run_soon(ir_worker_t* worker);
+static void worker_feed(ir_worker_t* worker);
+static void worker_resume(ir_worker_t* worker);
+static void worker_resume_soon(ir_worker_t* worker);
+static bool worker_async(ir_worker_t* worker);
+static bool worker_timed(ir_worker_t* worker);
+static bool worker_admit(ir_worker_t* worker);
+static ir_limit_class_t limit_class(uint8_t type);
+static uint8_t job_status(ir_job_result_t result);
 static bool read_request(ir_worker_t* worker);
+static bool read_discard(ir_worker_t* worker);
+static bool read_http_head(ir_worker_t* worker);
+static bool http_route(ir_worker_t* worker);
+static bool http_library_key(ir_worker_t* worker, string_t* key);
+static void http_receive_query(ir_worker_t* worker);
+static bool read_http_times(ir_worker_t* worker);
+static bool read_http_number(ir_worker_t* worker);
 static bool read_send_request(ir_worker_t* worker);
+static bool read_send_stream(ir_worker_t* worker);
+static bool read_batch_send_request(ir_worker_t* worker);
 static bool read_receive_request(ir_worker_t* worker);
 static bool read_config_request(ir_worker_t* worker);
+static bool read_library_key(ir_worker_t* worker);
+static bool read_library_put_request(ir_worker_t* worker);
+static bool read_sequence_put_request(ir_worker_t* worker);
+static bool read_rule_put_request(ir_worker_t* worker);
+static bool read_subscribe_request(ir_worker_t* worker);
+static bool read_probe_request(ir_worker_t* worker);
+static bool read_cancel_request(ir_worker_t* worker);
 static bool process(ir_worker_t* worker);
 static bool process_send(ir_worker_t* worker);
 static bool process_receive(ir_worker_t* worker);
-static void send_buffer(ir_worker_t* worker);
+static void receive_timeout(ir_worker_t* worker);
+static void receive_release(ir_worker_t* worker);
+static ir_library_entry_t* library_lookup(ir_worker_t* worker);
+static bool process_library_put(ir_worker_t* worker);
+static bool process_library_delete(ir_worker_t* worker);
+static bool process_library_send(ir_worker_t* worker);
+static bool process_sequence_put(ir_worker_t* worker);
+static bool process_sequence_run(ir_worker_t* worker);
+static bool process_sequence_cancel(ir_worker_t* worker);
+static bool process_rule_put(ir_worker_t* worker);
+static bool process_subscribe(ir_worker_t* worker);
+static bool process_cancel(ir_worker_t* worker);
+static void send_done(ir_job_t* job, ir_job_result_t result);
+static bool stream_start(ir_worker_t* worker);
+static void stream_transmit(ir_worker_t* worker);
+static void stream_release(ir_worker_t* worker);
+static void send_async_done(ir_job_t* job, ir_job_result_t result);
+static bool process_batch_send(ir_worker_t* worker);
+static bool batch_submit(ir_worker_t* worker);
+static void batch_done(ir_job_t* job, ir_job_result_t result);
+static bool send_buffer(ir_worker_t* worker);
+static uint16_t http_code(uint8_t status);
+static bool http_text(ir_worker_t* worker);
+static bool http_head(ir_worker_t* worker, bool binary, uint16_t length);
 static bool write_response(ir_worker_t* worker);
+static bool write_head(stream_t* s, uint8_t version, uint8_t type, uint16_t id, uint8_t flags, uint8_t status, uint16_t length);
 static bool write_response_head(ir_worker_t* worker, uint8_t type, uint16_t length);
+static bool write_status(ir_worker_t* worker, uint8_t type, uint16_t id, uint8_t status);
+static bool write_message(ir_worker_t* worker, uint8_t type, uint16_t id, uint8_t status, uint8_t* body, uint8_t length);
 static bool write_send_response(ir_worker_t* worker);
+static bool write_batch_send_response(ir_worker_t* worker);
 static bool write_receive_response(ir_worker_t* worker);
+static bool write_http_receive_response(ir_worker_t* worker);
 static bool write_config_response(ir_worker_t* worker);
+static bool write_result_response(ir_worker_t* worker, uint8_t type);
+static bool write_library_list_response(ir_worker_t* worker);
+static bool write_http_library_list_response(ir_worker_t* worker);
+static bool write_stats_response(ir_worker_t* worker);
+static bool write_time_response(ir_worker_t* worker);
+static bool write_probe_response(ir_worker_t* worker);
+static bool write_hello_response(ir_worker_t* worker);
+static bool write_cancel_response(ir_worker_t* worker);
 static bool finish(ir_worker_t* worker);
 static bool finish_config(ir_worker_t* worker);
+static bool finish_subscribe(ir_worker_t* worker);
 
 static void connect(server_socket_t* server, socket_t* client);
 static void receive(socket_t* client, uint8_t* data, uint16_t length);
@@ -40,6 +112,17 @@ static void sent(socket_t* client);
 static void disconnect(socket_t* client);
 
 static void signal_received(signal_station_t* station);
+static void sequence_progress(ir_sequencer_t* sequencer, ir_job_result_t result, bool done);
+static void rule_notify(ir_rules_t* rules, ir_rule_t* rule, uint32_t key);
+static void capture_publish(ir_rules_t* rules, uint16_t* times, uint16_t count, uint32_t fingerprint, bool nec, uint32_t code);
+
+static ir_subscriber_t* subscriber_alloc(ir_server_t* server);
+static bool subscriber_wants(ir_subscriber_t* subscriber, uint32_t fingerprint, bool nec, uint32_t code);
+static void subscriber_receive(socket_t* client, uint8_t* data, uint16_t length);
+static void subscriber_sent(socket_t* client);
+static void subscriber_disconnect(socket_t* client);
+static void subscriber_error(socket_t* client, int8_t error);
+static void event_release(socket_t* client, void* reverse);
 
 
 ir_server_t* ICACHE_FLASH_ATTR ir_server_create(ir_server_t* server, uint16_t port) {
@@ -51,21 +134,55 @@ ir_server_t* ICACHE_FLASH_ATTR ir_server_create(ir_server_t* server, uint16_t po
 
 	beacon_create(&server->beacon, IR_BEACON_PORT);
 	server->beacon.interval = IR_BEACON_INTERVAL;
+	server->beacon.interval_max = IR_BEACON_INTERVAL_MAX;
+	server->beacon.query.start = (uint8_t*) IR_BEACON_QUERY;
+	server->beacon.query.length = sizeof(IR_BEACON_QUERY) - 1;
+	server->beacon.reverse = server;
+	server->beacon.send_cb = beacon_refresh;
+	// a reboot must not hand out a generation clients already cached
+	server->generation = os_random();
 	stream_create(&server->beacon_out);
 	server->beacon_out.swap_endian = IR_SWAP_ENDIAN;
 	stack_buffer_create(&server->beacon_out.buffer, NULL, IR_BEACON_LENGTH_MAX);
 
-	ir_worker_create(&server->worker, server, NULL);
-
 	signal_station_create(&server->station);
 	server->station.time_length = IR_TIME_LENGTH;
 	server->station.signal_timeout = IR_TIMEOUT_SIGNAL;
 	server->station.pulse_timeout = IR_TIMEOUT_PULSE;
 	server->station.received_cb = signal_received;
 
+	ir_scheduler_create(&server->scheduler, &server->station, IR_GPIO_SEND);
+	server->clients = IR_SCHEDULER_CLIENT_NONE;
+	ir_limiter_create(&server->limiter);
+	ir_udp_create(&server->udp, &server->scheduler, &server->limiter, port);
+	ir_library_create(&server->library, IR_LIBRARY_ADDRESS);
+	ir_library_load(&server->library);
+	ir_sequencer_create(&server->sequencer, &server->scheduler, &server->library);
+	server->sequencer.reverse = server;
+	server->sequencer.progress_cb = sequence_progress;
+	ir_rules_create(&server->rules, &server->station, IR_GPIO_RECEIVE, &server->scheduler, &server->library, &server->sequencer);
+	server->rules.reverse = server;
+	server->rules.notify_cb = rule_notify;
+	server->rules.capture_cb = capture_publish;
+	m_memset(server->subscribers, 0, sizeof(server->subscribers));
+	ir_rules_load(&server->rules);
+
+	m_memset(&server->timeout, 0, sizeof(server->timeout));
+	server->timeout.limit[IR_PHASE_IDLE] = IR_TIMEOUT_IDLE;
+	server->timeout.limit[IR_PHASE_HEADER] = IR_TIMEOUT_HEADER;
+	server->timeout.limit[IR_PHASE_BODY] = IR_TIMEOUT_BODY;
+	server->timeout.limit[IR_PHASE_PROCESS] = IR_TIMEOUT_PROCESS;
+	server->timeout.limit[IR_PHASE_RESPONSE] = IR_TIMEOUT_RESPONSE;
+
+	m_memset(&server->stats, 0, sizeof(server->stats));
+	server->stats.heap_min = system_get_free_heap_size();
+
+	ir_worker_create(&server->worker, server, NULL);
+
 	stack_buffer_create(&server->name, NULL, IR_NAME_LENGTH_MAX);
 
 	server->running = false;
+	server->online = false;
 
 	return server;
 }
@@ -83,7 +200,9 @@ void ICACHE_FLASH_ATTR ir_server_start(ir_server_t* server) {
 
 	beacon_pack(server);
 	server_socket_accept(&server->socket);
-	beacon_start(&server->beacon);
+	ir_udp_start(&server->udp);
+	ir_rules_start(&server->rules);
+	if (server->online) beacon_start(&server->beacon);
 
 	server->running = true;
 }
@@ -92,14 +211,43 @@ void ICACHE_FLASH_ATTR ir_server_stop(ir_server_t* server) {
 	if (!server->running) return;
 
 	server_socket_close(&server->socket); // TODO: check
+	ir_udp_stop(&server->udp);
+	ir_rules_stop(&server->rules);
 	beacon_stop(&server->beacon);
 
 	server->running = false;
 }
 
+void ICACHE_FLASH_ATTR ir_server_timeout(ir_server_t* server, ir_phase_t phase, uint32_t timeout) {
+	if (phase >= IR_PHASES) return;
+	server->timeout.limit[phase] = timeout;
+}
+
+bool ICACHE_FLASH_ATTR ir_server_idle(ir_server_t* server) {
+	// nothing in flight that a stalled cpu would hurt
+	ir_worker_t* worker = &server->worker;
+	bool waiting = (worker->state == IR_WORKER_REQUEST) && (worker->phase == IR_PHASE_IDLE);
+	if ((worker->state != IR_WORKER_READY) && !waiting) return false;
+	if (stack_buffer_size(&worker->pending) > 0) return false;
+	if (server->sequencer.running) return false;
+	return ir_scheduler_idle(&server->scheduler);
+}
+
+void ICACHE_FLASH_ATTR ir_server_network(ir_server_t* server, bool online) {
+	if (server->online == online) return;
+	DEBUG("network %s", online ? "up" : "down");
+	server->online = online;
+	ir_udp_network(&server->udp, online);
+	if (!server->running) return;
+
+	// nobody hears announcements during an outage, they start over at the short interval
+	if (online) beacon_start(&server->beacon);
+	else beacon_stop(&server->beacon);
+}
+
 static void beacon_pack(ir_server_t* server) {
 	uint8_t name_length = stack_buffer_size(&server->name);
-	uint16_t length = IR_BEACON_HEAD_LENGTH + name_length;
+	uint16_t length = IR_BEACON_HEAD_LENGTH + name_length + IR_BEACON_FIELDS_LENGTH;
 	if (length > server->beacon_out.buffer.length) {
 		DEBUG_FUNCTION("buffer too small");
 		server->beacon.data.start = 0;
@@ -116,6 +264,20 @@ static void beacon_pack(ir_server_t* server) {
 	done &= stream_write_primitive(s, &name_length, 1);
 	done &= stream_write(s, server->name.start, name_length);
 
+	server->beacon_fields.offset = IR_BEACON_HEAD_LENGTH + name_length;
+	server->beacon_fields.load = beacon_load(server);
+	server->beacon_fields.depth = ir_scheduler_depth(&server->scheduler);
+	server->beacon_fields.rssi = wifi_station_get_rssi();
+	server->beacon_fields.uptime = ir_scheduler_clock(&server->scheduler) / 1000000;
+	server->beacon_fields.generation = server->generation;
+	uint16_t features = IR_FEATURES;
+	done &= stream_write_primitive(s, &server->beacon_fields.load, 1);
+	done &= stream_write_primitive(s, &server->beacon_fields.depth, 1);
+	done &= stream_write_primitive(s, &server->beacon_fields.rssi, 1);
+	done &= stream_write_primitive(s, &server->beacon_fields.uptime, 4);
+	done &= stream_write_primitive(s, &features, 2);
+	done &= stream_write_primitive(s, &server->beacon_fields.generation, 2);
+
 	if (!done) {
 		DEBUG_FUNCTION("write error");
 		server->beacon.data.start = 0;
@@ -127,6 +289,54 @@ static void beacon_pack(ir_server_t* server) {
 	server->beacon.data.length = length;
 }
 
+static void ICACHE_FLASH_ATTR beacon_refresh(beacon_t* beacon) {
+	ir_server_t* server = (ir_server_t*) beacon->reverse;
+	if (beacon->data.length <= 0) return;
+
+	// the fields sit at fixed offsets behind the name, the rest of the packet stays as packed
+	uint8_t* fields = server->beacon_out.buffer.start + server->beacon_fields.offset;
+	uint8_t load = beacon_load(server);
+	if (load != server->beacon_fields.load) {
+		server->beacon_fields.load = load;
+		beacon_patch(fields, load, 1);
+	}
+	uint8_t depth = ir_scheduler_depth(&server->scheduler);
+	if (depth != server->beacon_fields.depth) {
+		server->beacon_fields.depth = depth;
+		beacon_patch(fields + 1, depth, 1);
+	}
+	sint8 rssi = wifi_station_get_rssi();
+	if (rssi != server->beacon_fields.rssi) {
+		server->beacon_fields.rssi = rssi;
+		beacon_patch(fields + 2, (uint8_t) rssi, 1);
+	}
+	uint32_t uptime = ir_scheduler_clock(&server->scheduler) / 1000000;
+	if (uptime != server->beacon_fields.uptime) {
+		server->beacon_fields.uptime = uptime;
+		beacon_patch(fields + 3, uptime, 4);
+	}
+	if (server->generation != server->beacon_fields.generation) {
+		server->beacon_fields.generation = server->generation;
+		beacon_patch(fields + 9, server->generation, 2);
+	}
+}
+
+static uint8_t ICACHE_FLASH_ATTR beacon_load(ir_server_t* server) {
+	// 0 free, 1 a client is connected, 2 a request is being worked on
+	ir_worker_t* worker = &server->worker;
+	if (worker->socket == NULL) return 0;
+	if ((worker->state == IR_WORKER_PROCESS) || (worker->state == IR_WORKER_RESPONSE)) return 2;
+	return 1;
+}
+
+static void ICACHE_FLASH_ATTR beacon_patch(uint8_t* field, uint32_t value, uint8_t length) {
+	// big endian like everything the stream writes
+	while (length-- > 0) {
+		field[length] = value & 0xFF;
+		value >>= 8;
+	}
+}
+
 ir_worker_t* ICACHE_FLASH_ATTR ir_worker_create(ir_worker_t* worker, ir_server_t* server, socket_t* socket) {
 	if (worker == NULL) worker = (ir_worker_t*) m_malloc(sizeof(ir_worker_t));
 
@@ -138,10 +348,17 @@ ir_worker_t* ICACHE_FLASH_ATTR ir_worker_create(ir_worker_t* worker, ir_server_t
 	stack_buffer_create(&worker->out.buffer, NULL, IR_SEND_BUFFER_LENGTH);
 
 	stack_buffer_create(&worker->buffer, NULL, IR_BUFFER_LENGTH);
+	stack_buffer_create(&worker->pending, NULL, IR_PENDING_LENGTH);
+	m_memset(worker->batch, 0, sizeof(worker->batch));
 
+	worker->server = server;
+	worker->socket = NULL;
+	worker->client = IR_SCHEDULER_CLIENT_NONE;
+	worker->state = IR_WORKER_READY;
+	worker->entered = system_get_time();
+	worker->stream.active = false;
 	ir_worker_reset(worker);
 	worker->socket = socket;
-	worker->server = server;
 
 	return worker;
 }
@@ -153,47 +370,326 @@ void ICACHE_FLASH_ATTR ir_worker_destroy(ir_worker_t* worker, bool all) {
 void ICACHE_FLASH_ATTR ir_worker_reset(ir_worker_t* worker) {
 	if (worker->socket) socket_close(worker->socket);
 	worker->socket = NULL;
-	worker->state = IR_WORKER_READY;
+	worker_state(worker, IR_WORKER_READY);
+	worker->persistent = false;
+	worker->http = false;
+	worker->stopping = false;
+	worker->retry = 0;
+	os_timer_disarm(&worker->timer);
+	os_timer_disarm(&worker->timeout);
+	worker->phase = IR_PHASE_IDLE;
 
+	// jobs still referencing the worker buffer must not fire
+	stream_release(worker);
+	ir_scheduler_cancel(&worker->server->scheduler, worker->client);
+	worker->client = IR_SCHEDULER_CLIENT_NONE;
+
+	worker_release(worker);
 	stream_reset(&worker->in);
+	stream_data(&worker->in, NULL, 0);
 	stream_reset(&worker->out);
 	stack_buffer_reset(&worker->buffer);
+	stack_buffer_reset(&worker->pending);
+	worker->held = false;
 
-	signal_station_reset(&worker->server->station);
+	receive_release(worker);
+
+	m_memset(&worker->timing, 0, sizeof(worker->timing));
+	m_memset(&worker->last, 0, sizeof(worker->last));
+	m_memset(&worker->request, 0, sizeof(worker->request));
+	m_memset(&worker->process, 0, sizeof(worker->process));
+	m_memset(&worker->response, 0, sizeof(worker->response));
+}
+
+void ICACHE_FLASH_ATTR ir_worker_next(ir_worker_t* worker) {
+	worker_release(worker);
+	worker_state(worker, IR_WORKER_REQUEST);
+	worker->in.position = 0;
+	stream_reset(&worker->out);
+	stack_buffer_reset(&worker->buffer);
+	worker_phase(worker, IR_PHASE_IDLE);
 
+	// a probe reports on the request before it
+	worker->last = worker->timing;
+	m_memset(&worker->timing, 0, sizeof(worker->timing));
 	m_memset(&worker->request, 0, sizeof(worker->request));
 	m_memset(&worker->process, 0, sizeof(worker->process));
 	m_memset(&worker->response, 0, sizeof(worker->response));
+
+	worker_resume_soon(worker);
+}
+
+static void ICACHE_FLASH_ATTR worker_release(ir_worker_t* worker) {
+	stream_release(worker);
+	bool send = (worker->request.type == IR_SEND_REQUEST) || (worker->request.type == IR_LIBRARY_SEND_REQUEST);
+	if (send && worker->request.send.owned) {
+		stack_buffer_destroy(&worker->request.send.times, false);
+		worker->request.send.owned = false;
+	}
+
+	// items that never made it into the scheduler still hold their times
+	uint8_t i = 0;
+	while (i < IR_BATCH_ITEMS_MAX) {
+		ir_batch_item_t* item = &worker->batch[i++];
+		if (item->times.start == NULL) continue;
+		stack_buffer_destroy(&item->times, false);
+		item->times.start = NULL;
+	}
+}
+
+static void ICACHE_FLASH_ATTR worker_cancel(ir_worker_t* worker) {
+	// whatever the request started is let go right here instead of from the next timer
+	ir_server_t* server = worker->server;
+	// a reset worker has nothing of its own, a cancel without a client would hit everybody
+	if (worker->client == IR_SCHEDULER_CLIENT_NONE) return;
+	os_timer_disarm(&worker->timer);
+	stream_release(worker);
+	receive_release(worker);
+
+	switch (worker->request.type) {
+	case IR_SEND_REQUEST:
+	case IR_LIBRARY_SEND_REQUEST:
+		if (!worker_async(worker)) ir_scheduler_cancel_tag(&server->scheduler, worker->client, worker->request.id);
+		break;
+	case IR_BATCH_SEND_REQUEST:
+		// items are chained, only the current one is queued
+		ir_scheduler_cancel_tag(&server->scheduler, worker->client, worker->process.batch.index);
+		break;
+	}
+}
+
+static void ICACHE_FLASH_ATTR worker_intercept(ir_worker_t* worker) {
+	// a cancel at the front of the parked data is taken out of turn while a request is in flight
+	if (worker->state != IR_WORKER_PROCESS) return;
+	if (!worker->persistent || worker->http) return;
+
+	uint8_t* head = worker->pending.start;
+	uint16_t size = stack_buffer_size(&worker->pending);
+	if (size < IR_HEAD_LENGTH) return;
+	if ((head[0] != (IR_PROTOCOL_VERSIONED | IR_PROTOCOL_VERSION)) || (head[1] != IR_CANCEL_REQUEST)) return;
+	uint16_t id = (head[2] << 8) | head[3];
+	uint16_t length = (head[6] << 8) | head[7];
+	// anything else is left for the parser to reject in order
+	if ((length != 0) && (length != 2)) return;
+	if (size < IR_HEAD_LENGTH + length) return;
+	bool targeted = length > 0;
+	uint16_t target = targeted ? (head[8] << 8) | head[9] : 0;
+
+	uint16_t n = IR_HEAD_LENGTH + length;
+	m_memmove(head, head + n, size - n);
+	stack_buffer_reset(&worker->pending);
+	stack_buffer_skip(&worker->pending, size - n);
+	worker->server->stats.requests[IR_CANCEL_REQUEST]++;
+	DEBUG("cancel %d", target);
+
+	uint8_t count = 0;
+	bool current = !targeted || (target == worker->request.id);
+	if (current) {
+		// completions of the request are ignored from here on
+		worker_state(worker, IR_WORKER_FINISH);
+		worker_cancel(worker);
+		if (!write_status(worker, IR_ERROR_RESPONSE, worker->request.id, IR_STATUS_CANCELLED)) return;
+		count++;
+	}
+	if (!current || !targeted) count += cancel_queued(worker, targeted, target);
+	if (!write_message(worker, IR_CANCEL_RESPONSE, id, IR_STATUS_OK, &count, 1)) return;
+
+	if (current) ir_worker_next(worker);
+	if ((stack_buffer_size(&worker->pending) <= 0) && worker->held) {
+		socket_unhold(worker->socket);
+		worker->held = false;
+	}
+}
+
+static uint8_t ICACHE_FLASH_ATTR cancel_queued(ir_worker_t* worker, bool targeted, uint16_t target) {
+	ir_server_t* server = worker->server;
+	uint8_t count = targeted ? ir_scheduler_cancel_tag(&server->scheduler, worker->client, target)
+			: ir_scheduler_cancel(&server->scheduler, worker->client);
+
+	ir_sequencer_t* sequencer = &server->sequencer;
+	bool owned = ir_sequencer_running(sequencer) && (sequencer->owner == worker->client);
+	if (owned && (!targeted || (sequencer->tag == target)) && ir_sequencer_cancel(sequencer)) count++;
+	return count;
 }
 
 static void ICACHE_FLASH_ATTR worker_stop(ir_worker_t* worker) {
-	worker->state = IR_WORKER_FINISH;
+	worker_state(worker, IR_WORKER_FINISH);
+	worker->stopping = true;
 	worker_run_soon(worker);
 }
 
-// TODO: worker timeout
+static void ICACHE_FLASH_ATTR worker_fail(ir_worker_t* worker, uint8_t status) {
+	if (status == IR_STATUS_OVERFLOW) worker->server->stats.overflows++;
+
+	// v1 has no way to report errors, the connection is closed
+	if (!worker->persistent && !worker->http) {
+		worker_stop(worker);
+		return;
+	}
+
+	DEBUG("fail %d", status);
+	if (worker->http) {
+		worker->response.status = status;
+		if (!write_response_head(worker, IR_ERROR_RESPONSE, 0)) return;
+		if (!send_buffer(worker)) return;
+		socket_flush(worker->socket);
+	} else {
+		// a busy answer may tell how many milliseconds to back off
+		uint8_t body[2] = {worker->retry >> 8, worker->retry & 0xFF};
+		if (!write_message(worker, IR_ERROR_RESPONSE, worker->request.id, status, body, (worker->retry > 0) ? 2 : 0)) return;
+	}
+	worker_release(worker);
+
+	if (!worker->persistent) {
+		// http without keep-alive closes once the answer is out
+		worker_state(worker, IR_WORKER_RESPONSE);
+		worker->response.state = 1;
+		worker->stopping = true;
+		return;
+	}
+	if (worker->state == IR_WORKER_REQUEST) {
+		// the rest of the body is skipped, the connection stays usable
+		worker->in.position = 0;
+		worker->request.state = 7;
+	} else {
+		ir_worker_next(worker);
+	}
+}
+
+static void ICACHE_FLASH_ATTR worker_phase(ir_worker_t* worker, ir_phase_t phase) {
+	worker->phase = phase;
+	os_timer_disarm(&worker->timeout);
+
+	uint32_t timeout = worker->server->timeout.limit[phase];
+	if (timeout <= 0) return;
+	os_timer_setfn(&worker->timeout, worker_timeout, worker);
+	os_timer_arm(&worker->timeout, timeout, false);
+}
+
+static void ICACHE_FLASH_ATTR worker_state(ir_worker_t* worker, ir_worker_state_t state) {
+	if (worker->state == state) return;
+
+	// one bucket increment per transition, the heap is sampled along the way
+	ir_server_t* server = worker->server;
+	uint32_t now = system_get_time();
+	uint32_t time = (now - worker->entered) >> IR_STATS_SHIFT;
+	uint8_t bucket = 0;
+	while ((time > 0) && (bucket < IR_STATS_BUCKETS - 1)) {
+		time >>= 1;
+		bucket++;
+	}
+	server->stats.states[worker->state][bucket]++;
+	server->stats.heap_min = MIN(server->stats.heap_min, system_get_free_heap_size());
+
+	worker->state = state;
+	worker->entered = now;
+}
+
+static void ICACHE_FLASH_ATTR worker_timeout(ir_worker_t* worker) {
+	if (worker->socket == NULL) return;
+	DEBUG("timeout phase %d", worker->phase);
+	worker->server->timeout.fired[worker->phase]++;
+
+	// an idle connection has no request to answer
+	if (worker->persistent && !worker->http && (worker->phase != IR_PHASE_IDLE)) {
+		if (!write_status(worker, IR_ERROR_RESPONSE, worker->request.id, IR_STATUS_TIMEOUT)) return;
+	}
+	worker_stop(worker);
+}
+
+static bool ICACHE_FLASH_ATTR worker_async(ir_worker_t* worker) {
+	// a streamed send is answered once the transmitter is done, like a synchronous one
+	if (worker->request.flags & IR_FLAG_STREAM) return false;
+	return (worker->request.version >= IR_PROTOCOL_VERSION) && (worker->request.flags & IR_FLAG_ASYNC);
+}
+
+static bool ICACHE_FLASH_ATTR worker_timed(ir_worker_t* worker) {
+	return (worker->request.version >= IR_PROTOCOL_VERSION) && (worker->request.flags & IR_FLAG_AT);
+}
+
+static bool ICACHE_FLASH_ATTR worker_admit(ir_worker_t* worker) {
+	ir_server_t* server = worker->server;
+	bool refused = worker->retry > 0;
+	ir_limit_class_t limit = limit_class(worker->request.type);
+	uint16_t retry = refused ? worker->retry : ir_limiter_take(&server->limiter, worker->ip, limit);
+	// clients on the soft ap may still talk to us, but nothing is sent while the station is down
+	if ((retry <= 0) && !server->online && (limit == IR_LIMIT_SEND)) retry = IR_OFFLINE_RETRY;
+	if (retry <= 0) return true;
+
+	DEBUG("limited, retry %d", retry);
+	worker->retry = retry;
+	worker_fail(worker, IR_STATUS_BUSY);
+	worker->retry = 0;
+	if (refused && (worker->state == IR_WORKER_REQUEST)) {
+		// the connection itself was over its limit, it is closed once the answer is out
+		worker->request.state = 0;
+		worker_state(worker, IR_WORKER_RESPONSE);
+		worker->response.state = 1;
+		worker->stopping = true;
+	}
+	return false;
+}
+
+static ir_limit_class_t ICACHE_FLASH_ATTR limit_class(uint8_t type) {
+	switch (type) {
+	case IR_SEND_REQUEST:
+	case IR_BATCH_SEND_REQUEST:
+	case IR_LIBRARY_SEND_REQUEST:
+	case IR_SEQUENCE_RUN_REQUEST:
+		return IR_LIMIT_SEND;
+	}
+	return IR_LIMIT_OTHER;
+}
+
+static uint8_t ICACHE_FLASH_ATTR job_status(ir_job_result_t result) {
+	switch (result) {
+	case IR_JOB_SENT:
+		return IR_STATUS_OK;
+	case IR_JOB_EXPIRED:
+		return IR_STATUS_EXPIRED;
+	case IR_JOB_CANCELLED:
+		return IR_STATUS_CANCELLED;
+	case IR_JOB_REJECTED:
+		return IR_STATUS_REJECTED;
+	}
+	return IR_STATUS_ERROR;
+}
+
 // TODO: stop beacon
 static void ICACHE_FLASH_ATTR worker_run(ir_worker_t* worker) {
 	switch (worker->state) {
 	case IR_WORKER_READY:
-		worker->state = IR_WORKER_REQUEST;
+		worker_state(worker, IR_WORKER_REQUEST);
 		/* no break */
 	case IR_WORKER_REQUEST:
 		if (!read_request(worker)) break;
-		worker->state = IR_WORKER_PROCESS;
+		if (worker->request.type < IR_PACKET_TYPES) worker->server->stats.requests[worker->request.type]++;
+		worker->timing.type = worker->request.type;
+		worker->timing.parsed = system_get_time();
+		worker_state(worker, IR_WORKER_PROCESS);
+		worker_phase(worker, IR_PHASE_PROCESS);
+		worker->timing.processing = system_get_time();
 		/* no break */
 	case IR_WORKER_PROCESS:
 		if (!process(worker)) break;
-		worker->state = IR_WORKER_RESPONSE;
+		worker->timing.processed = system_get_time();
+		worker_state(worker, IR_WORKER_RESPONSE);
+		worker_phase(worker, IR_PHASE_RESPONSE);
 		/* no break */
 	case IR_WORKER_RESPONSE:
 		if (!write_response(worker)) break;
-		worker->state = IR_WORKER_FINISH;
+		if (worker->timing.queued == 0) worker->timing.queued = system_get_time();
+		worker_state(worker, IR_WORKER_FINISH);
 		/* no break */
 	case IR_WORKER_FINISH:
 	{
+		if (worker->stopping) {
+			ir_worker_reset(worker);
+			break;
+		}
 		if (!finish(worker)) break;
-		ir_worker_reset(worker);
+		if (worker->persistent) ir_worker_next(worker);
+		else ir_worker_reset(worker);
 		break;
 	}
 	default:
@@ -209,26 +705,142 @@ static void ICACHE_FLASH_ATTR worker_run_soon(ir_worker_t* worker) {
 	os_timer_arm(&worker->timer, IR_DELAY_SOON, false);
 }
 
+static void ICACHE_FLASH_ATTR worker_feed(ir_worker_t* worker) {
+	while (stream_left(&worker->in) > 0) {
+		if ((worker->state != IR_WORKER_READY) && (worker->state != IR_WORKER_REQUEST)) break;
+		uint16_t left = stream_left(&worker->in);
+		worker_run(worker);
+		if (stream_left(&worker->in) >= left) break;
+	}
+	if (worker->socket == NULL) return;
+
+	uint16_t left = stream_left(&worker->in);
+	if (left <= 0) {
+		if (worker->held) {
+			socket_unhold(worker->socket);
+			worker->held = false;
+		}
+		return;
+	}
+
+	// keep what the busy worker could not take and stop the peer until it is parsed
+	if (worker->in.buffer.start == worker->pending.start) {
+		m_memmove(worker->pending.start, worker->in.buffer.position, left);
+		stack_buffer_reset(&worker->pending);
+		stack_buffer_skip(&worker->pending, left);
+	} else if (left <= stack_buffer_left(&worker->pending)) {
+		if (stack_buffer_size(&worker->pending) <= 0) worker->pending_arrived = worker->arrived;
+		stack_buffer_pushn(&worker->pending, worker->in.buffer.position, left);
+	} else {
+		DEBUG_FUNCTION("pending overflow");
+		worker_stop(worker);
+		return;
+	}
+	stream_data(&worker->in, NULL, 0);
+
+	if (!worker->held) {
+		socket_hold(worker->socket);
+		worker->held = true;
+	}
+	worker_intercept(worker);
+}
+
+static void ICACHE_FLASH_ATTR worker_resume_soon(ir_worker_t* worker) {
+	// data that arrived while the worker was busy is parsed outside of the current callback
+	if (stack_buffer_size(&worker->pending) > 0) {
+		os_timer_disarm(&worker->timer);
+		os_timer_setfn(&worker->timer, worker_resume, worker);
+		os_timer_arm(&worker->timer, 0, false);
+	}
+}
+
+static void ICACHE_FLASH_ATTR worker_resume(ir_worker_t* worker) {
+	uint16_t size = stack_buffer_size(&worker->pending);
+	if (size <= 0) return;
+	if (worker->socket == NULL) return;
+
+	worker->arrived = worker->pending_arrived;
+	stream_data(&worker->in, worker->pending.start, size);
+	stack_buffer_reset(&worker->pending);
+	worker_feed(worker);
+}
+
 static bool ICACHE_FLASH_ATTR read_request(ir_worker_t* worker) {
+	bool v2 = worker->request.version >= IR_PROTOCOL_VERSION;
+
 	switch (worker->request.state) {
 	case 0:
-		if (!stream_read_primitive(&worker->in, &worker->request.type, 1)) break;
-		DEBUG("type %d", worker->request.type);
+	{
+		uint8_t head;
+		if (!stream_read_primitive(&worker->in, &head, 1)) break;
+		if (worker->phase == IR_PHASE_IDLE) worker_phase(worker, IR_PHASE_HEADER);
+		// the segment carrying the first byte
+		worker->timing.arrived = worker->arrived;
+		if (BETWEEN(head, 'A', 'Z')) {
+			// no packet type is that large, a letter starts a http request line
+			worker->http = true;
+			worker->request.version = 1;
+			ir_http_reset(&worker->request.http);
+			ir_http_push(&worker->request.http, head);
+			worker->request.state = 8;
+			return read_request(worker);
+		}
+		if (head & IR_PROTOCOL_VERSIONED) {
+			worker->request.version = head & ~IR_PROTOCOL_VERSIONED;
+			if (worker->request.version != IR_PROTOCOL_VERSION) {
+				DEBUG_FUNCTION("unsupported version");
+				worker_stop(worker);
+				return false;
+			}
+			worker->persistent = true;
+		} else {
+			worker->request.version = 1;
+			worker->request.type = head;
+		}
+		v2 = worker->request.version >= IR_PROTOCOL_VERSION;
 		worker->request.state++;
+	}
 		/* no break */
 	case 1:
+		if (v2 && !stream_read_primitive(&worker->in, &worker->request.type, 1)) break;
+		DEBUG("type %d", worker->request.type);
+		worker->request.state++;
+		/* no break */
+	case 2:
+		if (v2 && !stream_read_primitive(&worker->in, &worker->request.id, 2)) break;
+		worker->request.state++;
+		/* no break */
+	case 3:
+		if (v2 && !stream_read_primitive(&worker->in, &worker->request.flags, 1)) break;
+		worker->request.state++;
+		/* no break */
+	case 4:
+		// status is only meaningful in responses
+		if (v2 && !stream_read_primitive(&worker->in, NULL, 1)) break;
+		worker->request.state++;
+		/* no break */
+	case 5:
 		if (!stream_read_primitive(&worker->in, &worker->request.length, 2)) break;
 		DEBUG("length %d", worker->request.length);
+		worker_phase(worker, IR_PHASE_BODY);
 		worker->request.state++;
+		if (!worker_admit(worker)) {
+			if (worker->request.state == 7) return read_discard(worker);
+			return false;
+		}
 		/* no break */
-	case 2:
+	case 6:
 	{
 		bool done = false;
 		uint8_t* start = worker->in.buffer.position;
 
 		switch (worker->request.type) {
 		case IR_SEND_REQUEST:
-			done = read_send_request(worker);
+			if (worker->http && !worker->request.http.binary) done = read_http_times(worker);
+			else done = read_send_request(worker);
+			break;
+		case IR_BATCH_SEND_REQUEST:
+			done = read_batch_send_request(worker);
 			break;
 		case IR_RECEIVE_REQUEST:
 			done = read_receive_request(worker);
@@ -236,68 +848,433 @@ static bool ICACHE_FLASH_ATTR read_request(ir_worker_t* worker) {
 		case IR_CONFIG_REQUEST:
 			done = read_config_request(worker);
 			break;
+		case IR_LIBRARY_PUT_REQUEST:
+			done = read_library_put_request(worker);
+			break;
+		case IR_SEQUENCE_PUT_REQUEST:
+			done = read_sequence_put_request(worker);
+			break;
+		case IR_LIBRARY_DELETE_REQUEST:
+		case IR_LIBRARY_SEND_REQUEST:
+		case IR_SEQUENCE_RUN_REQUEST:
+			// http carries the key in the path
+			done = worker->http || read_library_key(worker);
+			break;
+		case IR_SEQUENCE_CANCEL_REQUEST:
+			done = true;
+			break;
+		case IR_RULE_PUT_REQUEST:
+			done = read_rule_put_request(worker);
+			break;
+		case IR_SUBSCRIBE_REQUEST:
+			done = read_subscribe_request(worker);
+			break;
+		case IR_LIBRARY_LIST_REQUEST:
+		case IR_STATS_REQUEST:
+		case IR_TIME_REQUEST:
+		case IR_HELLO_REQUEST:
+			done = true;
+			break;
+		case IR_PROBE_REQUEST:
+			done = read_probe_request(worker);
+			break;
+		case IR_CANCEL_REQUEST:
+			done = read_cancel_request(worker);
+			break;
 		default:
 			DEBUG_FUNCTION("illegal request");
-			worker_stop(worker);
-			return false;
+			worker_fail(worker, IR_STATUS_UNSUPPORTED);
+			break;
 		}
 
 		uint16_t read = worker->in.buffer.position - start;
 		worker->request.read += read;
+		if (worker->request.read > worker->request.length) {
+			DEBUG_FUNCTION("read beyond request");
+			worker_stop(worker);
+			return false;
+		}
+		if (worker->request.state == 7) return read_discard(worker);
+		if (worker->state != IR_WORKER_REQUEST) return false;
 		if (done ^ (worker->request.read == worker->request.length)) {
 			DEBUG_FUNCTION("illegal read state");
 			DEBUG("read %d/%d", worker->request.read, worker->request.length);
-			// TODO: error
-			worker_stop(worker);
+			worker_fail(worker, IR_STATUS_MALFORMED);
+			if (worker->request.state == 7) return read_discard(worker);
 			return false;
 		}
 		if (done && (worker->request.read == worker->request.length)) return true;
 		break;
 	}
+	case 7:
+		return read_discard(worker);
+	case 8:
+		if (!read_http_head(worker)) {
+			if (worker->request.state == 7) return read_discard(worker);
+			break;
+		}
+		worker->request.state = 6;
+		if (!worker_admit(worker)) {
+			if (worker->request.state == 7) return read_discard(worker);
+			return false;
+		}
+		return read_request(worker);
+	}
+
+	return false;
+}
+
+static bool ICACHE_FLASH_ATTR read_discard(ir_worker_t* worker) {
+	uint16_t n = MIN(worker->request.length - worker->request.read, stream_left(&worker->in));
+	stack_buffer_skip(&worker->in.buffer, n);
+	worker->request.read += n;
+
+	if (worker->request.read >= worker->request.length) ir_worker_next(worker);
+	return false;
+}
+
+static bool ICACHE_FLASH_ATTR read_http_head(ir_worker_t* worker) {
+	ir_http_t* http = &worker->request.http;
+
+	while (stream_left(&worker->in) > 0) {
+		ir_http_result_t result = ir_http_push(http, *(worker->in.buffer.position++));
+		if (result == IR_HTTP_BUSY) continue;
+		if (result == IR_HTTP_MALFORMED) {
+			// the body length is unknown, nothing after this can be trusted
+			DEBUG_FUNCTION("malformed http");
+			worker->persistent = false;
+			worker_fail(worker, IR_STATUS_MALFORMED);
+			return false;
+		}
+		return http_route(worker);
 	}
 
 	return false;
 }
 
+static bool ICACHE_FLASH_ATTR http_route(ir_worker_t* worker) {
+	ir_http_t* http = &worker->request.http;
+	worker->persistent = http->keep_alive;
+	worker->request.length = http->content_length;
+	worker_phase(worker, IR_PHASE_BODY);
+	DEBUG("http %d %d", http->method, http->content_length);
+
+	string_t rest;
+	if ((http->method == IR_HTTP_POST) && ir_http_path(http, "/send", 5, &rest) && (rest.length <= 0)) {
+		worker->request.type = IR_SEND_REQUEST;
+	} else if ((http->method == IR_HTTP_GET) && ir_http_path(http, "/receive", 8, &rest) && (rest.length <= 0)) {
+		worker->request.type = IR_RECEIVE_REQUEST;
+		http_receive_query(worker);
+	} else if ((http->method == IR_HTTP_GET) && ir_http_path(http, "/library", 8, &rest) && (rest.length <= 0)) {
+		worker->request.type = IR_LIBRARY_LIST_REQUEST;
+	} else if ((http->method == IR_HTTP_POST) && ir_http_path(http, "/library", 8, &rest) && (rest.length > 0)) {
+		worker->request.type = IR_LIBRARY_SEND_REQUEST;
+		if (!http_library_key(worker, &rest)) return false;
+	} else if ((http->method == IR_HTTP_PUT) && ir_http_path(http, "/library", 8, &rest) && (rest.length > 0)) {
+		worker->request.type = IR_LIBRARY_PUT_REQUEST;
+		if (!http_library_key(worker, &rest)) return false;
+		// the body starts after the key, with the frequency
+		worker->request.library.state = 3;
+	} else if ((http->method == IR_HTTP_DELETE) && ir_http_path(http, "/library", 8, &rest) && (rest.length > 0)) {
+		worker->request.type = IR_LIBRARY_DELETE_REQUEST;
+		if (!http_library_key(worker, &rest)) return false;
+	} else {
+		DEBUG_FUNCTION("no route");
+		worker_fail(worker, IR_STATUS_NOT_FOUND);
+		return false;
+	}
+
+	// only sends understand the compact text form, everything else takes the binary body
+	if ((worker->request.length > 0) && !http->binary && (worker->request.type != IR_SEND_REQUEST)) {
+		worker_fail(worker, IR_STATUS_MALFORMED);
+		return false;
+	}
+
+	if (http->expect_continue && (worker->request.length > 0)) {
+		if (!ir_http_write_continue(&worker->out)) return false;
+		if (!send_buffer(worker)) return false;
+		socket_flush(worker->socket);
+	}
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR http_library_key(ir_worker_t* worker, string_t* key) {
+	// all digits is an id, anything else a name, an id followed by a slash names it as well
+	uint32_t id = 0;
+	uint8_t i = 0;
+	while ((i < key->length) && BETWEEN(key->buffer[i], '0', '9') && (id <= 0xFFFF)) {
+		id = id * 10 + (key->buffer[i++] - '0');
+	}
+	if ((i >= key->length) && (id <= 0xFFFF)) {
+		worker->request.library.id = id;
+		return true;
+	}
+	if ((i > 0) && (key->buffer[i] == '/') && (id <= 0xFFFF)) {
+		worker->request.library.id = id;
+		key->buffer += i + 1;
+		key->length -= i + 1;
+	}
+
+	if ((key->length <= 0) || (key->length > IR_LIBRARY_NAME_LENGTH_MAX)) {
+		worker_fail(worker, IR_STATUS_NOT_FOUND);
+		return false;
+	}
+	m_memcpy(worker->request.library.name, key->buffer, key->length);
+	worker->request.library.name_length = key->length;
+	return true;
+}
+
+static void ICACHE_FLASH_ATTR http_receive_query(ir_worker_t* worker) {
+	// the query takes the place of the binary receive body
+	ir_http_t* http = &worker->request.http;
+	uint32_t value;
+	worker->request.receive.wait = IR_HTTP_RECEIVE_WAIT;
+	if (ir_http_query(http, "wait", 4, &value) && (value > 0)) worker->request.receive.wait = value;
+	if (ir_http_query(http, "frames", 6, &value)) {
+		worker->request.receive.framed = true;
+		worker->request.receive.frames = MIN(MAX(value, 1), IR_RECEIVE_FRAMES_MAX);
+	}
+	if (ir_http_query(http, "gap", 3, &value)) worker->request.receive.gap = MIN(value, IR_RECEIVE_GAP_MAX);
+}
+
+static bool ICACHE_FLASH_ATTR read_http_times(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	ir_http_t* http = &worker->request.http;
+	if (worker->request.send.state == 0) {
+		stack_buffer_create(&worker->request.send.times, worker->buffer.position, stack_buffer_left(&worker->buffer));
+		worker->request.send.state++;
+	}
+
+	// the frequency comes first, then the times, separated by commas or whitespace
+	uint16_t body = worker->request.length - worker->request.read;
+	uint16_t left = MIN(body, stream_left(&worker->in));
+	bool end = left >= body;
+	while (left-- > 0) {
+		char c = *(worker->in.buffer.position++);
+		if (BETWEEN(c, '0', '9')) {
+			http->number = http->number * 10 + (c - '0');
+			http->digits = true;
+			if (http->number > 0xFFFFFF) {
+				worker_fail(worker, IR_STATUS_MALFORMED);
+				return false;
+			}
+			continue;
+		}
+		if ((c != ',') && !is_whitespace(c)) {
+			worker_fail(worker, IR_STATUS_MALFORMED);
+			return false;
+		}
+		if (!read_http_number(worker)) return false;
+	}
+	if (!end) return false;
+
+	if (!read_http_number(worker)) return false;
+	if (!http->frequency) {
+		worker_fail(worker, IR_STATUS_MALFORMED);
+		return false;
+	}
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR read_http_number(ir_worker_t* worker) {
+	ir_http_t* http = &worker->request.http;
+	if (!http->digits) return true;
+
+	uint32_t number = http->number;
+	http->number = 0;
+	http->digits = false;
+
+	if (!http->frequency) {
+		worker->request.send.frequency = number;
+		http->frequency = true;
+		return true;
+	}
+	if (number > 0xFFFF) {
+		worker_fail(worker, IR_STATUS_MALFORMED);
+		return false;
+	}
+	if (stack_buffer_left(&worker->request.send.times) < IR_TIME_LENGTH) {
+		DEBUG_FUNCTION("buffer overflow");
+		worker_fail(worker, IR_STATUS_OVERFLOW);
+		return false;
+	}
+	uint16_t time = number;
+	stack_buffer_pushn(&worker->request.send.times, &time, IR_TIME_LENGTH);
+	worker->request.send.length++;
+	return true;
+}
+
 static bool ICACHE_FLASH_ATTR read_send_request(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
 	switch (worker->request.send.state) {
 	case 0:
+		// a timed send carries its fire time in device clock microseconds first
+		if (worker_timed(worker) && !stream_read_primitive(&worker->in, &worker->request.send.at, 8)) break;
+		worker->request.send.state++;
+		/* no break */
+	case 1:
 		if (!stream_read_primitive(&worker->in, &worker->request.send.frequency, 4)) break;
 		DEBUG("frequency %d", worker->request.send.frequency);
 		worker->request.send.state++;
 		/* no break */
-	case 1:
+	case 2:
 		if (!stream_read_primitive(&worker->in, &worker->request.send.length, 2)) break;
 		DEBUG("length %d", worker->request.send.length);
-		if (worker->request.send.length > worker->buffer.length) {
+		if ((worker->request.version >= IR_PROTOCOL_VERSION) && (worker->request.flags & IR_FLAG_STREAM)) {
+			if (worker_timed(worker)) {
+				DEBUG_FUNCTION("stream cannot wait");
+				worker_fail(worker, IR_STATUS_UNSUPPORTED);
+				return false;
+			}
+			if (!stream_start(worker)) {
+				DEBUG_FUNCTION("transmitter busy");
+				worker_fail(worker, IR_STATUS_BUSY);
+				return false;
+			}
+			worker->request.send.state = 4;
+			return read_send_stream(worker);
+		}
+		if (worker->request.send.length > stack_buffer_left(&worker->buffer) / IR_TIME_LENGTH) {
 			DEBUG_FUNCTION("buffer overflow");
-			// TODO: error
-			worker_stop(worker);
+			worker_fail(worker, IR_STATUS_OVERFLOW);
 			return false;
 		}
-		worker->request.send.state++;
-		/* no break */
-	case 2:
-		while (true) {
-			if (worker->request.send.read == worker->request.send.length) {
-				return true;
+		if (worker_async(worker)) {
+			// asynchronous jobs own their times, the worker buffer is reused by the next request
+			uint16_t length = IR_TIME_LENGTH * worker->request.send.length;
+			stack_buffer_create(&worker->request.send.times, NULL, length);
+			if ((length > 0) && (worker->request.send.times.start == NULL)) {
+				DEBUG_FUNCTION("out of memory");
+				worker_fail(worker, IR_STATUS_OVERFLOW);
+				return false;
 			}
-			if (!stream_read_primitive(&worker->in, worker->buffer.position, IR_TIME_LENGTH)) break;
-			worker->buffer.position += IR_TIME_LENGTH;
-			worker->request.send.read++;
+			worker->request.send.owned = length > 0;
+		} else {
+			stack_buffer_create(&worker->request.send.times, worker->buffer.position, stack_buffer_left(&worker->buffer));
 		}
+		worker->request.send.state++;
+		/* no break */
+	case 3:
+		// times are copied straight into the transmit buffer, partial times are carried over by the stream
+		if (!stream_read_array(&worker->in, worker->request.send.times.start, IR_TIME_LENGTH, worker->request.send.length)) break;
+		stack_buffer_skip(&worker->request.send.times, IR_TIME_LENGTH * worker->request.send.length);
+		return true;
+	case 4:
+		return read_send_stream(worker);
 	}
 
 	return false;
 }
 
-static bool ICACHE_FLASH_ATTR read_receive_request(ir_worker_t* worker) {
-	DEBUG_FUNCTION_START();
+static bool ICACHE_FLASH_ATTR read_send_stream(ir_worker_t* worker) {
+	while (worker->request.send.received < worker->request.send.length) {
+		uint8_t fill = worker->request.send.fill;
+		stack_buffer_t* block = &worker->stream.blocks[fill];
+		// both blocks wait for the transmitter, the rest stays in pending with the socket held
+		if (worker->stream.ready[fill]) return false;
+
+		uint16_t count = MIN(stack_buffer_left(block) / IR_TIME_LENGTH, worker->request.send.length - worker->request.send.received);
+		if (!stream_read_array(&worker->in, block->position, IR_TIME_LENGTH, count)) return false;
+		stack_buffer_skip(block, IR_TIME_LENGTH * count);
+		worker->request.send.received += count;
+		worker->stream.ready[fill] = true;
+		worker->request.send.fill = (fill + 1) % IR_STREAM_BLOCKS;
+
+		if (worker->stream.starved) stream_transmit(worker);
+	}
+
+	// nothing left to wait for, an empty signal finishes right away
+	if (worker->stream.starved) stream_transmit(worker);
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR read_batch_send_request(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	if (worker->request.batch.state == 0) {
+		if (!stream_read_primitive(&worker->in, &worker->request.batch.count, 1)) return false;
+		DEBUG("count %d", worker->request.batch.count);
+		if (worker->request.batch.count > IR_BATCH_ITEMS_MAX) {
+			DEBUG_FUNCTION("too many items");
+			worker_fail(worker, IR_STATUS_OVERFLOW);
+			return false;
+		}
+		worker->request.batch.state++;
+	}
+
+	while (worker->request.batch.index < worker->request.batch.count) {
+		ir_batch_item_t* item = &worker->batch[worker->request.batch.index];
+
+		switch (worker->request.batch.state) {
+		case 1:
+			if (!stream_read_primitive(&worker->in, &item->frequency, 4)) return false;
+			worker->request.batch.state++;
+			/* no break */
+		case 2:
+			if (!stream_read_primitive(&worker->in, &item->repeat, 1)) return false;
+			worker->request.batch.state++;
+			/* no break */
+		case 3:
+			if (!stream_read_primitive(&worker->in, &item->delay, 2)) return false;
+			worker->request.batch.state++;
+			/* no break */
+		case 4:
+			if (!stream_read_primitive(&worker->in, &worker->request.batch.length, 2)) return false;
+			if (worker->request.batch.length > IR_TIMES_MAX) {
+				DEBUG_FUNCTION("buffer overflow");
+				worker_fail(worker, IR_STATUS_OVERFLOW);
+				return false;
+			}
+			// every item owns its times, a scene is not limited by the worker buffer
+			stack_buffer_create(&item->times, NULL, IR_TIME_LENGTH * worker->request.batch.length);
+			if ((worker->request.batch.length > 0) && (item->times.start == NULL)) {
+				DEBUG_FUNCTION("out of memory");
+				worker_fail(worker, IR_STATUS_OVERFLOW);
+				return false;
+			}
+			worker->request.batch.state++;
+			/* no break */
+		case 5:
+			if (!stream_read_array(&worker->in, item->times.start, IR_TIME_LENGTH, worker->request.batch.length)) return false;
+			stack_buffer_skip(&item->times, IR_TIME_LENGTH * worker->request.batch.length);
+			item->result = IR_JOB_REJECTED;
+			worker->request.batch.index++;
+			worker->request.batch.state = 1;
+			break;
+		}
+	}
+
 	return true;
 }
 
+static bool ICACHE_FLASH_ATTR read_receive_request(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// an empty body is the old single frame receive without a limit
+	if (worker->request.length <= 0) return true;
+	worker->request.receive.framed = true;
+
+	switch (worker->request.receive.state) {
+	case 0:
+		if (!stream_read_primitive(&worker->in, &worker->request.receive.wait, 2)) break;
+		worker->request.receive.state++;
+		/* no break */
+	case 1:
+		if (!stream_read_primitive(&worker->in, &worker->request.receive.frames, 1)) break;
+		worker->request.receive.frames = MIN(MAX(worker->request.receive.frames, 1), IR_RECEIVE_FRAMES_MAX);
+		worker->request.receive.state++;
+		/* no break */
+	case 2:
+		if (!stream_read_primitive(&worker->in, &worker->request.receive.gap, 2)) break;
+		worker->request.receive.gap = MIN(worker->request.receive.gap, IR_RECEIVE_GAP_MAX);
+		return true;
+	}
+
+	return false;
+}
+
 static bool ICACHE_FLASH_ATTR read_config_request(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
@@ -307,7 +1284,7 @@ static bool ICACHE_FLASH_ATTR read_config_request(ir_worker_t* worker) {
 		DEBUG("name length %d", worker->request.config.length);
 		if (worker->request.config.length > worker->server->name.length) {
 			DEBUG_FUNCTION("buffer overflow");
-			worker_stop(worker);
+			worker_fail(worker, IR_STATUS_OVERFLOW);
 			return false;
 		}
 		stack_buffer_reset(&worker->server->name);
@@ -324,7 +1301,7 @@ static bool ICACHE_FLASH_ATTR read_config_request(ir_worker_t* worker) {
 		DEBUG("ssid length %d", worker->request.config.length);
 		if (worker->request.config.length > stack_buffer_left(&worker->buffer)) {
 			DEBUG_FUNCTION("buffer overflow");
-			worker_stop(worker);
+			worker_fail(worker, IR_STATUS_OVERFLOW);
 			return false;
 		}
 		string_create(&worker->request.config.ssid, worker->buffer.position, worker->request.config.length, false);
@@ -340,7 +1317,7 @@ static bool ICACHE_FLASH_ATTR read_config_request(ir_worker_t* worker) {
 		DEBUG("ssid length %d", worker->request.config.length);
 		if (worker->request.config.length > stack_buffer_left(&worker->buffer)) {
 			DEBUG_FUNCTION("buffer overflow");
-			worker_stop(worker);
+			worker_fail(worker, IR_STATUS_OVERFLOW);
 			return false;
 		}
 		string_create(&worker->request.config.password, worker->buffer.position, worker->request.config.length, false);
@@ -355,257 +1332,1568 @@ static bool ICACHE_FLASH_ATTR read_config_request(ir_worker_t* worker) {
 	return false;
 }
 
-static bool ICACHE_FLASH_ATTR process(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR read_library_key(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
-	switch (worker->process.state) {
+	switch (worker->request.library.state) {
 	case 0:
-	{
-		worker_run_soon(worker);
-		worker->process.state++;
-		break;
-	}
+		if (!stream_read_primitive(&worker->in, &worker->request.library.id, 2)) break;
+		DEBUG("id %d", worker->request.library.id);
+		worker->request.library.state++;
+		/* no break */
 	case 1:
-	{
-		switch (worker->request.type) {
-		case IR_SEND_REQUEST:
-			return process_send(worker);
-		case IR_RECEIVE_REQUEST:
-			return process_receive(worker);
-		case IR_CONFIG_REQUEST:
-			return true;
-		default:
-			DEBUG_FUNCTION("illegal state");
-			worker_stop(worker);
+		if (!stream_read_primitive(&worker->in, &worker->request.library.name_length, 1)) break;
+		if (worker->request.library.name_length > IR_LIBRARY_NAME_LENGTH_MAX) {
+			DEBUG_FUNCTION("name too long");
+			worker_fail(worker, IR_STATUS_OVERFLOW);
 			return false;
 		}
-
-		return false;
+		worker->request.library.state++;
+		/* no break */
+	case 2:
+		if (!stream_read(&worker->in, worker->request.library.name, worker->request.library.name_length)) break;
+		worker->request.library.state++;
+		return true;
 	}
+
+	return false;
+}
+
+static bool ICACHE_FLASH_ATTR read_library_put_request(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	switch (worker->request.library.state) {
+	case 0:
+	case 1:
+	case 2:
+		if (!read_library_key(worker)) break;
+		/* no break */
+	case 3:
+		if (!stream_read_primitive(&worker->in, &worker->request.library.frequency, 4)) break;
+		worker->request.library.state++;
+		/* no break */
+	case 4:
+		if (!stream_read_primitive(&worker->in, &worker->request.library.length, 2)) break;
+		if (worker->request.library.length > stack_buffer_left(&worker->buffer) / IR_TIME_LENGTH) {
+			DEBUG_FUNCTION("buffer overflow");
+			worker_fail(worker, IR_STATUS_OVERFLOW);
+			return false;
+		}
+		worker->request.library.state++;
+		/* no break */
+	case 5:
+		if (!stream_read_array(&worker->in, worker->buffer.start, IR_TIME_LENGTH, worker->request.library.length)) break;
+		stack_buffer_skip(&worker->buffer, IR_TIME_LENGTH * worker->request.library.length);
+		return true;
 	}
 
 	return false;
 }
 
-static bool ICACHE_FLASH_ATTR process_send(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR read_sequence_put_request(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
-	signal_station_t* station = (signal_station_t*) &worker->server->station;
-	station->gpio = IR_GPIO_SEND;
-	station->frequency = worker->request.send.frequency;
-	station->times = worker->buffer; // TODO: remove mem copy
+	if (worker->request.library.state < 3) {
+		if (!read_library_key(worker)) return false;
+	}
+	if (worker->request.library.state == 3) {
+		if (!stream_read_primitive(&worker->in, &worker->request.library.count, 1)) return false;
+		DEBUG("steps %d", worker->request.library.count);
+		if (worker->request.library.count > IR_SEQUENCE_STEPS_MAX) {
+			DEBUG_FUNCTION("too many steps");
+			worker_fail(worker, IR_STATUS_OVERFLOW);
+			return false;
+		}
+		worker->request.library.state++;
+	}
+
+	ir_sequence_step_t* steps = (ir_sequence_step_t*) worker->buffer.start;
+	while (worker->request.library.index < worker->request.library.count) {
+		ir_sequence_step_t* step = &steps[worker->request.library.index];
+
+		switch (worker->request.library.state) {
+		case 4:
+			if (!stream_read_primitive(&worker->in, &step->id, 2)) return false;
+			worker->request.library.state++;
+			/* no break */
+		case 5:
+			if (!stream_read_primitive(&worker->in, &step->repeat, 1)) return false;
+			worker->request.library.state++;
+			/* no break */
+		case 6:
+			if (!stream_read_primitive(&worker->in, &step->delay, 2)) return false;
+			step->reserved = 0;
+			worker->request.library.index++;
+			worker->request.library.state = 4;
+			break;
+		}
+	}
 
-	signal_send(station);
+	stack_buffer_skip(&worker->buffer, worker->request.library.count * sizeof(ir_sequence_step_t));
 	return true;
 }
 
-static bool ICACHE_FLASH_ATTR process_receive(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR read_rule_put_request(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
-	switch (worker->process.receive.state) {
-	case 0:
-	{
-		signal_station_t* station = (signal_station_t*) &worker->server->station;
-		station->gpio = IR_GPIO_RECEIVE;
-		station->times = worker->buffer; // TODO: remove mem copy
-		station->reverse = worker;
+	ir_rule_t* rule = (ir_rule_t*) worker->buffer.start;
 
-		signal_receive_next(&worker->server->station);
-		worker->process.receive.state++;
-		break;
+	switch (worker->request.library.state) {
+	case 0:
+	case 1:
+	case 2:
+		if (!read_library_key(worker)) break;
+		m_memset(rule, 0, sizeof(ir_rule_t));
+		/* no break */
+	case 3:
+		if (!stream_read_primitive(&worker->in, &rule->match, 1)) break;
+		worker->request.library.state++;
+		/* no break */
+	case 4:
+		if (!stream_read_primitive(&worker->in, &rule->key, 4)) break;
+		worker->request.library.state++;
+		/* no break */
+	case 5:
+		if (!stream_read_primitive(&worker->in, &rule->action, 1)) break;
+		worker->request.library.state++;
+		/* no break */
+	case 6:
+		if (!stream_read_primitive(&worker->in, &rule->gpio, 1)) break;
+		worker->request.library.state++;
+		/* no break */
+	case 7:
+		if (!stream_read_primitive(&worker->in, &rule->repeat, 1)) break;
+		worker->request.library.state++;
+		/* no break */
+	case 8:
+		if (!stream_read_primitive(&worker->in, &rule->target, 2)) break;
+		stack_buffer_skip(&worker->buffer, sizeof(ir_rule_t));
+		return true;
 	}
+
+	return false;
+}
+
+static bool ICACHE_FLASH_ATTR read_subscribe_request(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	switch (worker->request.subscribe.state) {
+	case 0:
+		if (!stream_read_primitive(&worker->in, &worker->request.subscribe.filter, 1)) break;
+		worker->request.subscribe.state++;
+		/* no break */
 	case 1:
-		DEBUG("times %d", signal_station_size(&worker->server->station));
+		if (!stream_read_primitive(&worker->in, &worker->request.subscribe.key, 4)) break;
 		return true;
 	}
 
 	return false;
 }
 
-static void ICACHE_FLASH_ATTR send_buffer(ir_worker_t* worker) {
-	if (worker->send_lock) {
-		DEBUG_FUNCTION("locked");
-		return;
+static bool ICACHE_FLASH_ATTR read_probe_request(ir_worker_t* worker) {
+	// the payload is echoed, clients can see what the size adds to the round trip
+	uint16_t body = worker->request.length - worker->request.read;
+	if (body > stack_buffer_left(&worker->buffer)) {
+		DEBUG_FUNCTION("buffer overflow");
+		worker_fail(worker, IR_STATUS_OVERFLOW);
+		return false;
 	}
+	uint16_t n = MIN(body, stream_left(&worker->in));
+	stack_buffer_pushn(&worker->buffer, worker->in.buffer.position, n);
+	stack_buffer_skip(&worker->in.buffer, n);
+	return n >= body;
+}
 
-	stream_t* s = &worker->out;
-	socket_send(worker->socket, s->buffer.start, stack_buffer_size(&s->buffer));
-	worker->send_lock = false;
-	stream_reset(s);
+static bool ICACHE_FLASH_ATTR read_cancel_request(ir_worker_t* worker) {
+	// an empty body cancels everything the connection has queued
+	if (worker->request.length <= 0) return true;
+	if (!stream_read_primitive(&worker->in, &worker->request.cancel.target, 2)) return false;
+	worker->request.cancel.targeted = true;
+	return true;
 }
 
-static bool ICACHE_FLASH_ATTR write_response(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR process(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
-	switch (worker->response.state) {
+	switch (worker->process.state) {
 	case 0:
 	{
-		bool done = false;
+		worker->process.state++;
+		// sends go through the scheduler, everything else leaves the network callback first
 		switch (worker->request.type) {
 		case IR_SEND_REQUEST:
-			done = write_send_response(worker);
+		case IR_BATCH_SEND_REQUEST:
+		case IR_LIBRARY_SEND_REQUEST:
 			break;
+		default:
+			worker_run_soon(worker);
+			return false;
+		}
+	}
+		/* no break */
+	case 1:
+	{
+		switch (worker->request.type) {
+		case IR_SEND_REQUEST:
+			return process_send(worker);
+		case IR_BATCH_SEND_REQUEST:
+			return process_batch_send(worker);
 		case IR_RECEIVE_REQUEST:
-			done = write_receive_response(worker);
-			break;
+			return process_receive(worker);
 		case IR_CONFIG_REQUEST:
-			done = write_config_response(worker);
-			break;
+			return true;
+		case IR_LIBRARY_PUT_REQUEST:
+			return process_library_put(worker);
+		case IR_LIBRARY_DELETE_REQUEST:
+			return process_library_delete(worker);
+		case IR_LIBRARY_LIST_REQUEST:
+		case IR_STATS_REQUEST:
+		case IR_TIME_REQUEST:
+		case IR_PROBE_REQUEST:
+		case IR_HELLO_REQUEST:
+			return true;
+		case IR_CANCEL_REQUEST:
+			return process_cancel(worker);
+		case IR_LIBRARY_SEND_REQUEST:
+			return process_library_send(worker);
+		case IR_SEQUENCE_PUT_REQUEST:
+			return process_sequence_put(worker);
+		case IR_SEQUENCE_RUN_REQUEST:
+			return process_sequence_run(worker);
+		case IR_SEQUENCE_CANCEL_REQUEST:
+			return process_sequence_cancel(worker);
+		case IR_RULE_PUT_REQUEST:
+			return process_rule_put(worker);
+		case IR_SUBSCRIBE_REQUEST:
+			return process_subscribe(worker);
 		default:
-			DEBUG_FUNCTION("unimplemented response");
+			DEBUG_FUNCTION("illegal state");
 			worker_stop(worker);
 			return false;
 		}
-		if (!done) break;
-		worker->response.state++;
+
+		return false;
 	}
-		/* no break */
-	case 1:
-		return !worker->send_lock;
 	}
-}
 
-static bool ICACHE_FLASH_ATTR write_response_head(ir_worker_t* worker, uint8_t type, uint16_t length) {
-	bool done = true;
-	stream_t* s = &worker->out;
-	done &= stream_write_primitive(s, &type, 1);
-	done &= stream_write_primitive(s, &length, 2);
-	if (!done) {
-		DEBUG_FUNCTION("write error");
-		worker_stop(worker);
-	}
-	return done;
+	return false;
 }
 
-static bool ICACHE_FLASH_ATTR write_send_response(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR process_send(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
-	if (!write_response_head(worker, IR_SEND_RESPONSE, 0)) return false;
-	send_buffer(worker);
-	return true;
-}
-
-static bool ICACHE_FLASH_ATTR write_receive_response(ir_worker_t* worker) {
-	DEBUG_FUNCTION_START();
+	// streamed times went out while they were read
+	if (worker->request.send.stream) return worker->stream.done;
 
-	switch (worker->response.receive.state) {
+	switch (worker->process.send.state) {
 	case 0:
 	{
-		uint16_t length = 4 + 2 + IR_TIME_LENGTH * signal_station_size(&worker->server->station);
-		if (!write_response_head(worker, IR_RECEIVE_RESPONSE, length)) return false;
-		worker->response.receive.state++;
-	}
-		/* no break */
-	case 1:
-	{
-		bool done = true;
-		stream_t* s = &worker->out;
-		uint32_t frequency = 0; // TODO: field
-		done &= stream_write_primitive(s, &frequency, 4);
-		uint16_t length = signal_station_size(&worker->server->station);
-		done &= stream_write_primitive(s, &length, 2);
-		if (!done) {
-			DEBUG_FUNCTION("buffer too small");
-			worker_stop(worker);
+		bool async = worker_async(worker);
+
+		ir_job_t job;
+		m_memset(&job, 0, sizeof(job));
+		job.priority = IR_PRIORITY_INTERACTIVE;
+		job.client = worker->client;
+		job.tag = worker->request.id;
+		job.deadline = system_get_time() + IR_SEND_DEADLINE * 1000;
+		job.frequency = worker->request.send.frequency;
+		job.times = worker->request.send.times;
+		if (worker_timed(worker)) {
+			uint64_t now = ir_scheduler_clock(&worker->server->scheduler);
+			uint64_t at = worker->request.send.at;
+			if (at > now + IR_SEND_AT_MAX * 1000ULL) {
+				DEBUG_FUNCTION("too far ahead");
+				worker_fail(worker, IR_STATUS_REJECTED);
+				return false;
+			}
+			// the low word of the clock is the system time, a time already past fires right away
+			job.timed = true;
+			job.at = (at > now) ? (uint32_t) at : (uint32_t) now;
+			job.deadline = job.at + IR_SEND_DEADLINE * 1000;
+		}
+		job.owned = worker->request.send.owned;
+		job.reverse = worker;
+		job.done_cb = async ? send_async_done : send_done;
+
+		if (!ir_scheduler_submit(&worker->server->scheduler, &job)) {
+			DEBUG_FUNCTION("scheduler full");
+			worker_fail(worker, IR_STATUS_BUSY);
 			return false;
 		}
-		worker->response.receive.state++;
+		worker->request.send.owned = false;
+		worker->process.send.state++;
+
+		// asynchronous completions are written when the job is done
+		return async;
 	}
-		/* no break */
+	case 1:
+		break;
 	case 2:
-	{
-		stream_t* s = &worker->out;
-		uint8_t* times = (uint8_t*) (worker->buffer.start + IR_TIME_LENGTH * worker->response.receive.written);
-		bool done = false;
-		while (true) {
-			if (worker->response.receive.written >= signal_station_size(&worker->server->station)) {
-				done = true;
-				break;
-			}
-			if (!stream_write_primitive(s, times, IR_TIME_LENGTH)) {
-				done = false;
-				break;
-			}
-			times += IR_TIME_LENGTH;
-			worker->response.receive.written++;
-		}
-		send_buffer(worker);
-		return done;
-	}
+		return true;
 	}
 
 	return false;
 }
 
-static bool ICACHE_FLASH_ATTR write_config_response(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR process_cancel(ir_worker_t* worker) {
 	DEBUG_FUNCTION_START();
 
-	if (!write_response_head(worker, IR_CONFIG_RESPONSE, 0)) return false;
-	send_buffer(worker);
+	// nothing is in flight when a cancel is parsed in turn, only queued work is left
+	worker->process.cancel.count = cancel_queued(worker, worker->request.cancel.targeted, worker->request.cancel.target);
 	return true;
 }
 
-static bool ICACHE_FLASH_ATTR finish(ir_worker_t* worker) {
-	switch (worker->request.type) {
-	case IR_SEND_REQUEST:
-		return true;
-	case IR_RECEIVE_REQUEST:
-		return true;
-	case IR_CONFIG_REQUEST:
-		return finish_config(worker);
-	default:
-		DEBUG_FUNCTION("illegal request");
-		worker_stop(worker);
-		return false;
-	}
+static void ICACHE_FLASH_ATTR send_done(ir_job_t* job, ir_job_result_t result) {
+	ir_worker_t* worker = (ir_worker_t*) job->reverse;
+	if (job->client != worker->client) return;
+	if (worker->state != IR_WORKER_PROCESS) return;
 
-	return false;
+	worker->process.send.result = result;
+	worker->response.status = job_status(result);
+	worker->process.send.state++;
+	worker_run(worker);
 }
 
-static bool ICACHE_FLASH_ATTR finish_config(ir_worker_t* worker) {
+static bool ICACHE_FLASH_ATTR stream_start(ir_worker_t* worker) {
 	ir_server_t* server = worker->server;
+	if (!ir_scheduler_hold(&server->scheduler, worker->client)) return false;
 
-	beacon_pack(server);
-	if (server->config_cb != NULL) {
-		server->config_cb(server, &worker->request.config.ssid, &worker->request.config.password);
-	}
+	// the station is borrowed the same way the scheduler does it for a job
+	signal_station_t* station = &server->station;
+	worker->stream.saved = *station;
+	signal_station_reset(station);
+	station->gpio = IR_GPIO_SEND;
+	station->frequency = worker->request.send.frequency;
+	signal_send_begin(station);
 
+	uint8_t i = 0;
+	while (i < IR_STREAM_BLOCKS) {
+		stack_buffer_create(&worker->stream.blocks[i], worker->buffer.start + i * IR_STREAM_BLOCK_LENGTH, IR_STREAM_BLOCK_LENGTH);
+		worker->stream.ready[i] = false;
+		i++;
+	}
+	worker->stream.block = 0;
+	worker->stream.active = true;
+	worker->stream.done = false;
+	worker->stream.starved = true;
+	worker->request.send.stream = true;
+	os_timer_disarm(&worker->stream.timer);
+	os_timer_setfn(&worker->stream.timer, stream_transmit, worker);
 	return true;
 }
 
-static void connect(server_socket_t* server, socket_t* client) {
-	ir_server_t* ir_server = (ir_server_t*) server->reverse;
-	if (ir_server->worker.state != IR_WORKER_READY) {
-		socket_close(client);
-		return;
+static void ICACHE_FLASH_ATTR stream_transmit(ir_worker_t* worker) {
+	ir_server_t* server = worker->server;
+	signal_station_t* station = &server->station;
+	worker->stream.starved = false;
+
+	while (true) {
+		uint8_t b = worker->stream.block;
+		stack_buffer_t* block = &worker->stream.blocks[b];
+		if (!worker->stream.ready[b]) {
+			if (worker->request.send.received >= worker->request.send.length) break;
+			// the client fell behind, the current space lasts until the next block is in
+			worker->stream.starved = true;
+			return;
+		}
+
+		if (station->times != block) {
+			station->times = block;
+			station->position = 0;
+		}
+		uint32_t start = system_get_time();
+		uint32_t gap = signal_send_part(station, IR_STREAM_YIELD);
+		server->scheduler.stats.airtime += system_get_time() - start;
+		if (gap > 0) {
+			// long spaces give the event loop a turn, that is when more times arrive
+			os_timer_arm(&worker->stream.timer, (gap + 500) / 1000, false);
+			return;
+		}
+
+		stack_buffer_reset(block);
+		worker->stream.ready[b] = false;
+		worker->stream.block = (b + 1) % IR_STREAM_BLOCKS;
+		station->times = NULL;
+		worker_resume_soon(worker);
 	}
 
-	ir_server->worker.socket = client;
+	stream_release(worker);
+	worker->stream.done = true;
+	worker->response.status = IR_STATUS_OK;
+	if (worker->state == IR_WORKER_PROCESS) worker_run(worker);
+}
 
-	client->reverse = &ir_server->worker;
-	client->receive_cb = receive;
-	client->sent_cb = sent;
-	client->disconnect_cb = disconnect;
+static void ICACHE_FLASH_ATTR stream_release(ir_worker_t* worker) {
+	if (!worker->stream.active) return;
+	worker->stream.active = false;
+	os_timer_disarm(&worker->stream.timer);
+
+	ir_server_t* server = worker->server;
+	signal_station_t* station = &server->station;
+	*station = worker->stream.saved;
+	if (station->receiving) signal_receive_next(station);
+	ir_scheduler_unhold(&server->scheduler, worker->client);
+	ir_rules_listen(&server->rules);
 }
 
-static void receive(socket_t* client, uint8_t* data, uint16_t length) {
-	DEBUG_FUNCTION_START();
-	DEBUG("tcp length %d", length);
+static void ICACHE_FLASH_ATTR send_async_done(ir_job_t* job, ir_job_result_t result) {
+	ir_worker_t* worker = (ir_worker_t*) job->reverse;
+	if (job->client != worker->client) return;
+	if (worker->socket == NULL) return;
 
-	ir_worker_t* worker = (ir_worker_t*) client->reverse;
-	stream_data(&worker->in, data, length);
-	worker_run(worker);
+	write_status(worker, IR_SEND_RESPONSE, job->tag, job_status(result));
 }
 
-static void sent(socket_t* client) {
-	ir_worker_t* worker = (ir_worker_t*) client->reverse;
-	worker->send_lock = true;
-	worker_run(worker);
+static bool ICACHE_FLASH_ATTR process_batch_send(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	switch (worker->process.batch.state) {
+	case 0:
+		worker->process.batch.state++;
+		if (batch_submit(worker)) break;
+		/* no break */
+	case 1:
+		return worker->process.batch.index >= worker->request.batch.count;
+	}
+
+	return false;
 }
 
-static void disconnect(socket_t* client) {
-	ir_worker_t* worker = (ir_worker_t*) client->reverse;
-	worker_stop(worker);
+static bool ICACHE_FLASH_ATTR batch_submit(ir_worker_t* worker) {
+	// items are chained, the next one is submitted when the previous one completed
+	while (worker->process.batch.index < worker->request.batch.count) {
+		ir_batch_item_t* item = &worker->batch[worker->process.batch.index];
+
+		ir_job_t job;
+		m_memset(&job, 0, sizeof(job));
+		job.priority = IR_PRIORITY_NORMAL;
+		job.client = worker->client;
+		job.tag = worker->process.batch.index;
+		job.frequency = item->frequency;
+		job.times = item->times;
+		job.repeat = item->repeat;
+		job.delay = item->delay;
+		job.owned = item->times.start != NULL;
+		job.reverse = worker;
+		job.done_cb = batch_done;
+
+		if (ir_scheduler_submit(&worker->server->scheduler, &job)) {
+			// the scheduler frees the times once the job is done
+			item->times.start = NULL;
+			return true;
+		}
+		item->result = IR_JOB_REJECTED;
+		worker->process.batch.index++;
+	}
+
+	return false;
+}
+
+static void ICACHE_FLASH_ATTR batch_done(ir_job_t* job, ir_job_result_t result) {
+	ir_worker_t* worker = (ir_worker_t*) job->reverse;
+	if (job->client != worker->client) return;
+	if (worker->state != IR_WORKER_PROCESS) return;
+
+	worker->batch[job->tag].result = result;
+	worker->process.batch.index = job->tag + 1;
+	if (batch_submit(worker)) return;
+	worker_run(worker);
+}
+
+static bool ICACHE_FLASH_ATTR process_receive(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	signal_station_t* station = &worker->server->station;
+
+	switch (worker->process.receive.state) {
+	case 0:
+	{
+		station->gpio = IR_GPIO_RECEIVE;
+		station->times = &worker->buffer;
+		station->reverse = worker;
+		station->received_cb = signal_received;
+		// a silence longer than the gap ends a frame
+		if (worker->request.receive.gap > 0) station->pulse_timeout = worker->request.receive.gap * 1000;
+
+		if (worker->request.receive.wait > 0) {
+			os_timer_disarm(&worker->timer);
+			os_timer_setfn(&worker->timer, receive_timeout, worker);
+			os_timer_arm(&worker->timer, worker->request.receive.wait, false);
+		}
+
+		signal_receive_next(station);
+		worker->process.receive.state++;
+		break;
+	}
+	case 1:
+	{
+		uint16_t size = signal_station_size(station);
+		uint16_t previous = 0;
+		uint8_t i = 0;
+		while (i < worker->process.receive.count) previous += worker->process.receive.sizes[i++];
+
+		// noise without a single edge does not count as a frame
+		if (size > previous) {
+			worker->process.receive.sizes[worker->process.receive.count++] = size - previous;
+			DEBUG("frame %d times %d", worker->process.receive.count, size - previous);
+		}
+
+		bool more = worker->request.receive.framed && (worker->process.receive.count < worker->request.receive.frames)
+				&& (stack_buffer_left(&worker->buffer) >= IR_TIME_LENGTH);
+		if (!worker->process.receive.timeout && ((worker->process.receive.count <= 0) || more)) {
+			signal_receive_next(station);
+			break;
+		}
+
+		os_timer_disarm(&worker->timer);
+		if (worker->process.receive.count <= 0) worker->response.status = IR_STATUS_TIMEOUT;
+		return true;
+	}
+	}
+
+	return false;
+}
+
+static void ICACHE_FLASH_ATTR receive_timeout(ir_worker_t* worker) {
+	if (worker->state != IR_WORKER_PROCESS) return;
+	if (worker->request.type != IR_RECEIVE_REQUEST) return;
+
+	DEBUG_FUNCTION("receive timeout");
+	signal_station_reset(&worker->server->station);
+	worker->process.receive.timeout = true;
+	worker_run(worker);
+}
+
+static void ICACHE_FLASH_ATTR receive_release(ir_worker_t* worker) {
+	// the receiver is only taken back from our own capture, rule listening goes on
+	signal_station_t* station = &worker->server->station;
+	if (station->reverse == worker) {
+		signal_station_reset(station);
+		station->reverse = NULL;
+		station->pulse_timeout = IR_TIMEOUT_PULSE;
+	}
+	ir_rules_listen(&worker->server->rules);
+}
+
+static ir_library_entry_t* ICACHE_FLASH_ATTR library_lookup(ir_worker_t* worker) {
+	ir_library_t* library = &worker->server->library;
+	if (worker->request.library.name_length > 0) {
+		return ir_library_find(library, worker->request.library.name, worker->request.library.name_length);
+	}
+	return ir_library_get(library, worker->request.library.id);
+}
+
+static bool ICACHE_FLASH_ATTR process_library_put(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// a path with only a name replaces the entry of that name
+	if (worker->http && (worker->request.library.id == IR_LIBRARY_ID_NONE)) {
+		ir_library_entry_t* entry = library_lookup(worker);
+		if (entry == NULL) {
+			worker->response.status = IR_STATUS_NOT_FOUND;
+			return true;
+		}
+		worker->request.library.id = entry->id;
+	}
+
+	bool done = ir_library_put(&worker->server->library, worker->request.library.id, IR_LIBRARY_SIGNAL,
+			worker->request.library.name, worker->request.library.name_length, worker->request.library.frequency,
+			worker->buffer.start, stack_buffer_size(&worker->buffer));
+	worker->response.status = done ? IR_STATUS_OK : IR_STATUS_ERROR;
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR process_library_delete(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	ir_library_entry_t* entry = library_lookup(worker);
+	bool rule = (entry != NULL) && (entry->kind == IR_LIBRARY_RULE);
+	bool done = (entry != NULL) && ir_library_delete(&worker->server->library, entry->id);
+	worker->response.status = done ? IR_STATUS_OK : IR_STATUS_NOT_FOUND;
+	if (done && rule) ir_rules_load(&worker->server->rules);
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR process_library_send(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	if (worker->process.send.state > 0) return process_send(worker);
+
+	ir_library_entry_t* entry = library_lookup(worker);
+	if ((entry == NULL) || (entry->kind != IR_LIBRARY_SIGNAL)) {
+		DEBUG_FUNCTION("not found");
+		worker_fail(worker, IR_STATUS_NOT_FOUND);
+		return false;
+	}
+	if (entry->length > stack_buffer_left(&worker->buffer)) {
+		DEBUG_FUNCTION("buffer overflow");
+		worker_fail(worker, IR_STATUS_OVERFLOW);
+		return false;
+	}
+
+	bool async = worker_async(worker);
+	stack_buffer_t times;
+	if (async) {
+		stack_buffer_create(&times, NULL, entry->length);
+		if (times.start == NULL) {
+			DEBUG_FUNCTION("out of memory");
+			worker_fail(worker, IR_STATUS_OVERFLOW);
+			return false;
+		}
+	} else {
+		stack_buffer_create(&times, worker->buffer.start, stack_buffer_left(&worker->buffer));
+	}
+	if (!ir_library_read(&worker->server->library, entry, times.start)) {
+		DEBUG_FUNCTION("read failed");
+		if (async) stack_buffer_destroy(&times, false);
+		worker_fail(worker, IR_STATUS_ERROR);
+		return false;
+	}
+	stack_buffer_skip(&times, entry->length);
+
+	// the key is not needed anymore, the stored signal continues as a plain send
+	uint32_t frequency = entry->frequency;
+	worker->request.send.frequency = frequency;
+	worker->request.send.length = entry->length / IR_TIME_LENGTH;
+	worker->request.send.times = times;
+	worker->request.send.owned = async;
+	worker->request.send.stream = false;
+
+	return process_send(worker);
+}
+
+static bool ICACHE_FLASH_ATTR process_sequence_put(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	bool done = ir_library_put(&worker->server->library, worker->request.library.id, IR_LIBRARY_SEQUENCE,
+			worker->request.library.name, worker->request.library.name_length, 0,
+			worker->buffer.start, stack_buffer_size(&worker->buffer));
+	worker->response.status = done ? IR_STATUS_OK : IR_STATUS_ERROR;
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR process_sequence_run(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	ir_sequencer_t* sequencer = &worker->server->sequencer;
+	ir_library_entry_t* entry = library_lookup(worker);
+	if ((entry == NULL) || (entry->kind != IR_LIBRARY_SEQUENCE)) {
+		worker->response.status = IR_STATUS_NOT_FOUND;
+	} else if (ir_sequencer_running(sequencer)) {
+		worker->response.status = IR_STATUS_BUSY;
+	} else {
+		// only v2 connections stay around to receive progress
+		uint16_t owner = worker->persistent ? worker->client : IR_SCHEDULER_CLIENT_NONE;
+		bool done = ir_sequencer_run(sequencer, entry, owner, worker->request.id);
+		worker->response.status = done ? IR_STATUS_OK : IR_STATUS_ERROR;
+	}
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR process_sequence_cancel(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	bool done = ir_sequencer_cancel(&worker->server->sequencer);
+	worker->response.status = done ? IR_STATUS_OK : IR_STATUS_NOT_FOUND;
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR process_rule_put(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	bool done = ir_library_put(&worker->server->library, worker->request.library.id, IR_LIBRARY_RULE,
+			worker->request.library.name, worker->request.library.name_length, 0,
+			worker->buffer.start, stack_buffer_size(&worker->buffer));
+	worker->response.status = done ? IR_STATUS_OK : IR_STATUS_ERROR;
+	if (done) ir_rules_load(&worker->server->rules);
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR process_subscribe(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// events are pushed unasked, v1 has no framing for that
+	if (!worker->persistent) {
+		worker_fail(worker, IR_STATUS_UNSUPPORTED);
+		return false;
+	}
+
+	ir_subscriber_t* subscriber = subscriber_alloc(worker->server);
+	worker->response.status = (subscriber != NULL) ? IR_STATUS_OK : IR_STATUS_BUSY;
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR send_buffer(ir_worker_t* worker) {
+	stream_t* s = &worker->out;
+	if (!socket_write(worker->socket, s->buffer.start, stack_buffer_size(&s->buffer))) {
+		worker_stop(worker);
+		return false;
+	}
+	stream_reset(s);
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR write_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	switch (worker->response.state) {
+	case 0:
+	{
+		bool done = false;
+		switch (worker->request.type) {
+		case IR_SEND_REQUEST:
+			done = write_send_response(worker);
+			break;
+		case IR_BATCH_SEND_REQUEST:
+			done = write_batch_send_response(worker);
+			break;
+		case IR_RECEIVE_REQUEST:
+			done = http_text(worker) ? write_http_receive_response(worker) : write_receive_response(worker);
+			break;
+		case IR_CONFIG_REQUEST:
+			done = write_config_response(worker);
+			break;
+		case IR_LIBRARY_PUT_REQUEST:
+			done = write_result_response(worker, IR_LIBRARY_PUT_RESPONSE);
+			break;
+		case IR_LIBRARY_DELETE_REQUEST:
+			done = write_result_response(worker, IR_LIBRARY_DELETE_RESPONSE);
+			break;
+		case IR_LIBRARY_LIST_REQUEST:
+			done = http_text(worker) ? write_http_library_list_response(worker) : write_library_list_response(worker);
+			break;
+		case IR_LIBRARY_SEND_REQUEST:
+			done = write_send_response(worker);
+			break;
+		case IR_SEQUENCE_PUT_REQUEST:
+			done = write_result_response(worker, IR_LIBRARY_PUT_RESPONSE);
+			break;
+		case IR_SEQUENCE_RUN_REQUEST:
+			done = write_result_response(worker, IR_SEQUENCE_RUN_RESPONSE);
+			break;
+		case IR_SEQUENCE_CANCEL_REQUEST:
+			done = write_result_response(worker, IR_SEQUENCE_CANCEL_RESPONSE);
+			break;
+		case IR_RULE_PUT_REQUEST:
+			done = write_result_response(worker, IR_LIBRARY_PUT_RESPONSE);
+			break;
+		case IR_SUBSCRIBE_REQUEST:
+			done = write_result_response(worker, IR_SUBSCRIBE_RESPONSE);
+			break;
+		case IR_STATS_REQUEST:
+			done = write_stats_response(worker);
+			break;
+		case IR_TIME_REQUEST:
+			done = write_time_response(worker);
+			break;
+		case IR_PROBE_REQUEST:
+			done = write_probe_response(worker);
+			break;
+		case IR_HELLO_REQUEST:
+			done = write_hello_response(worker);
+			break;
+		case IR_CANCEL_REQUEST:
+			done = write_cancel_response(worker);
+			break;
+		default:
+			DEBUG_FUNCTION("unimplemented response");
+			worker_stop(worker);
+			return false;
+		}
+		if (!done) break;
+		socket_flush(worker->socket);
+		worker->response.state++;
+	}
+		/* no break */
+	case 1:
+		return socket_idle(worker->socket);
+	}
+
+	return false;
+}
+
+static bool ICACHE_FLASH_ATTR write_head(stream_t* s, uint8_t version, uint8_t type, uint16_t id, uint8_t flags, uint8_t status, uint16_t length) {
+	bool done = true;
+	if (version >= IR_PROTOCOL_VERSION) {
+		uint8_t head = IR_PROTOCOL_VERSIONED | version;
+		done &= stream_write_primitive(s, &head, 1);
+		done &= stream_write_primitive(s, &type, 1);
+		done &= stream_write_primitive(s, &id, 2);
+		done &= stream_write_primitive(s, &flags, 1);
+		done &= stream_write_primitive(s, &status, 1);
+	} else {
+		done &= stream_write_primitive(s, &type, 1);
+	}
+	done &= stream_write_primitive(s, &length, 2);
+	return done;
+}
+
+static bool ICACHE_FLASH_ATTR write_response_head(ir_worker_t* worker, uint8_t type, uint16_t length) {
+	// binary bodies are the same over http, only the head differs
+	if (worker->http) return http_head(worker, true, length);
+
+	bool done = write_head(&worker->out, worker->request.version, type, worker->request.id,
+			worker->request.flags, worker->response.status, length);
+	if (!done) {
+		DEBUG_FUNCTION("write error");
+		worker_stop(worker);
+	}
+	return done;
+}
+
+static uint16_t ICACHE_FLASH_ATTR http_code(uint8_t status) {
+	switch (status) {
+	case IR_STATUS_OK:
+		return 200;
+	case IR_STATUS_MALFORMED:
+		return 400;
+	case IR_STATUS_UNSUPPORTED:
+	case IR_STATUS_NOT_FOUND:
+		return 404;
+	case IR_STATUS_OVERFLOW:
+		return 413;
+	case IR_STATUS_BUSY:
+	case IR_STATUS_EXPIRED:
+	case IR_STATUS_CANCELLED:
+	case IR_STATUS_REJECTED:
+		return 503;
+	case IR_STATUS_TIMEOUT:
+		return 504;
+	}
+	return 500;
+}
+
+static bool ICACHE_FLASH_ATTR http_text(ir_worker_t* worker) {
+	return worker->http && !worker->request.http.accept_binary;
+}
+
+static bool ICACHE_FLASH_ATTR http_head(ir_worker_t* worker, bool binary, uint16_t length) {
+	bool done = ir_http_write_head(&worker->out, http_code(worker->response.status), binary, length, worker->persistent);
+	if (!done) {
+		DEBUG_FUNCTION("write error");
+		worker_stop(worker);
+	}
+	return done;
+}
+
+static bool ICACHE_FLASH_ATTR write_status(ir_worker_t* worker, uint8_t type, uint16_t id, uint8_t status) {
+	return write_message(worker, type, id, status, NULL, 0);
+}
+
+static bool ICACHE_FLASH_ATTR write_message(ir_worker_t* worker, uint8_t type, uint16_t id, uint8_t status, uint8_t* body, uint8_t length) {
+	uint8_t buffer[IR_HEAD_LENGTH + IR_MESSAGE_LENGTH_MAX];
+	stream_t s;
+	stream_create(&s);
+	s.swap_endian = IR_SWAP_ENDIAN;
+	stack_buffer_create(&s.buffer, buffer, sizeof(buffer));
+	if (length > IR_MESSAGE_LENGTH_MAX) return false;
+
+	// written next to whatever response is in progress, responses are never interleaved
+	write_head(&s, IR_PROTOCOL_VERSION, type, id, 0, status, length);
+	stream_write(&s, body, length);
+	if (!socket_write(worker->socket, buffer, stack_buffer_size(&s.buffer))) {
+		worker_stop(worker);
+		return false;
+	}
+	socket_flush(worker->socket);
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR write_send_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	if (worker_async(worker)) return true;
+	if (!write_response_head(worker, IR_SEND_RESPONSE, 0)) return false;
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_batch_send_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	bool done = true;
+	uint8_t count = worker->request.batch.count;
+	if (!write_response_head(worker, IR_SEND_RESPONSE, 1 + count)) return false;
+	stream_t* s = &worker->out;
+	done &= stream_write_primitive(s, &count, 1);
+	uint8_t i = 0;
+	while (i < count) {
+		done &= stream_write_primitive(s, &worker->batch[i++].result, 1);
+	}
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_receive_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	bool done = true;
+	bool framed = worker->request.receive.framed;
+	uint8_t count = worker->process.receive.count;
+	uint16_t size = stack_buffer_size(&worker->buffer) / IR_TIME_LENGTH;
+	uint16_t length = 4 + (framed ? 1 + 2 * count : 2) + IR_TIME_LENGTH * size;
+	if (!write_response_head(worker, IR_RECEIVE_RESPONSE, length)) return false;
+	stream_t* s = &worker->out;
+	uint32_t frequency = 0; // TODO: field
+	done &= stream_write_primitive(s, &frequency, 4);
+	if (framed) {
+		// frame sizes first, the times of all frames follow back to back
+		done &= stream_write_primitive(s, &count, 1);
+		uint8_t i = 0;
+		while (i < count) done &= stream_write_primitive(s, &worker->process.receive.sizes[i++], 2);
+	} else {
+		done &= stream_write_primitive(s, &size, 2);
+	}
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	if (!send_buffer(worker)) return false;
+
+	// payload is queued straight from the capture buffer, it stays untouched until the queue drained
+	if (worker->out.swap_endian) {
+		array_swap_endian(worker->buffer.start, IR_TIME_LENGTH, size);
+	}
+	if (!socket_queue(worker->socket, worker->buffer.start, stack_buffer_size(&worker->buffer), NULL, NULL)) {
+		worker_stop(worker);
+		return false;
+	}
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR write_http_receive_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// the same compact form a send takes, a capture can be posted back as it is
+	uint16_t* times = (uint16_t*) worker->buffer.start;
+	uint16_t size = stack_buffer_size(&worker->buffer) / IR_TIME_LENGTH;
+	uint32_t frequency = 0; // TODO: field
+	uint16_t length = ir_http_digits(frequency) + 1;
+	uint16_t i = 0;
+	while (i < size) length += 1 + ir_http_digits(times[i++]);
+
+	if (!http_head(worker, false, length)) return false;
+	stream_t* s = &worker->out;
+	bool done = ir_http_write_number(s, frequency);
+	i = 0;
+	while (i < size) {
+		if (stream_left(s) < 1 + 5 + 1) {
+			if (!send_buffer(worker)) return false;
+		}
+		done &= stream_write(s, (uint8_t*) ",", 1);
+		done &= ir_http_write_number(s, times[i++]);
+	}
+	done &= stream_write(s, (uint8_t*) "\n", 1);
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_config_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	if (!write_response_head(worker, IR_CONFIG_RESPONSE, 0)) return false;
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_result_response(ir_worker_t* worker, uint8_t type) {
+	DEBUG_FUNCTION_START();
+
+	if (!write_response_head(worker, type, 1)) return false;
+	if (!stream_write_primitive(&worker->out, &worker->response.status, 1)) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_library_list_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	ir_library_t* library = &worker->server->library;
+	uint8_t count = library->count;
+	uint16_t length = 1;
+	uint8_t i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+		length += 2 + 1 + 4 + 2 + 1 + entry->name_length;
+	}
+
+	if (!write_response_head(worker, IR_LIBRARY_LIST_RESPONSE, length)) return false;
+	stream_t* s = &worker->out;
+	bool done = stream_write_primitive(s, &count, 1);
+
+	i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+
+		// the listing can be larger than the out buffer, it is handed to the socket piece by piece
+		if (stream_left(s) < 2 + 1 + 4 + 2 + 1 + IR_LIBRARY_NAME_LENGTH_MAX) {
+			if (!send_buffer(worker)) return false;
+		}
+
+		uint8_t name[IR_LIBRARY_NAME_LENGTH_MAX];
+		uint16_t times = entry->length / IR_TIME_LENGTH;
+		if (!ir_library_read_name(library, entry, name)) m_memset(name, 0, entry->name_length);
+		done &= stream_write_primitive(s, &entry->id, 2);
+		done &= stream_write_primitive(s, &entry->kind, 1);
+		done &= stream_write_primitive(s, &entry->frequency, 4);
+		done &= stream_write_primitive(s, &times, 2);
+		done &= stream_write_primitive(s, &entry->name_length, 1);
+		done &= stream_write(s, name, entry->name_length);
+	}
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_http_library_list_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// one line per entry: id,kind,frequency,times,name
+	ir_library_t* library = &worker->server->library;
+	uint16_t length = 0;
+	uint8_t i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+		length += ir_http_digits(entry->id) + 1 + ir_http_digits(entry->kind) + 1 + ir_http_digits(entry->frequency) + 1
+				+ ir_http_digits(entry->length / IR_TIME_LENGTH) + 1 + entry->name_length + 1;
+	}
+
+	if (!http_head(worker, false, length)) return false;
+	stream_t* s = &worker->out;
+	bool done = true;
+
+	i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library->entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+
+		if (stream_left(s) < 5 + 1 + 3 + 1 + 10 + 1 + 5 + 1 + IR_LIBRARY_NAME_LENGTH_MAX + 1) {
+			if (!send_buffer(worker)) return false;
+		}
+
+		uint8_t name[IR_LIBRARY_NAME_LENGTH_MAX];
+		if (!ir_library_read_name(library, entry, name)) m_memset(name, '?', entry->name_length);
+		done &= ir_http_write_number(s, entry->id);
+		done &= stream_write(s, (uint8_t*) ",", 1);
+		done &= ir_http_write_number(s, entry->kind);
+		done &= stream_write(s, (uint8_t*) ",", 1);
+		done &= ir_http_write_number(s, entry->frequency);
+		done &= stream_write(s, (uint8_t*) ",", 1);
+		done &= ir_http_write_number(s, entry->length / IR_TIME_LENGTH);
+		done &= stream_write(s, (uint8_t*) ",", 1);
+		done &= stream_write(s, name, entry->name_length);
+		done &= stream_write(s, (uint8_t*) "\n", 1);
+	}
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_stats_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	ir_server_t* server = worker->server;
+	uint8_t phases = IR_PHASES;
+	uint8_t types = IR_PACKET_TYPES;
+	uint8_t states = IR_WORKER_STATES;
+	uint8_t buckets = IR_STATS_BUCKETS;
+	uint8_t shift = IR_STATS_SHIFT;
+	uint16_t length = 6 * 4 + 1 + 4 * phases + 5 * 4 + 1 + 4 + 4 * 4 + 3 * 4 + 1 + 4 * types
+			+ 3 + 4 * states * buckets + 4 * 4;
+
+	uint32_t heap = system_get_free_heap_size();
+	server->stats.heap_min = MIN(server->stats.heap_min, heap);
+	uint32_t airtime = server->scheduler.stats.airtime / 1000;
+
+	if (!write_response_head(worker, IR_STATS_RESPONSE, length)) return false;
+	stream_t* s = &worker->out;
+	bool done = true;
+	done &= stream_write_primitive(s, &heap, 4);
+	done &= stream_write_primitive(s, &server->stats.heap_min, 4);
+	done &= stream_write_primitive(s, &airtime, 4);
+	done &= stream_write_primitive(s, &server->stats.refused, 4);
+	done &= stream_write_primitive(s, &server->stats.overflows, 4);
+	done &= stream_write_primitive(s, &server->station.overflows, 4);
+
+	uint8_t i = 0;
+	done &= stream_write_primitive(s, &phases, 1);
+	while (i < phases) done &= stream_write_primitive(s, &server->timeout.fired[i++], 4);
+
+	ir_scheduler_t* scheduler = &server->scheduler;
+	done &= stream_write_primitive(s, &scheduler->stats.submitted, 4);
+	done &= stream_write_primitive(s, &scheduler->stats.rejected, 4);
+	done &= stream_write_primitive(s, &scheduler->stats.sent, 4);
+	done &= stream_write_primitive(s, &scheduler->stats.expired, 4);
+	done &= stream_write_primitive(s, &scheduler->stats.cancelled, 4);
+	done &= stream_write_primitive(s, &scheduler->stats.depth_max, 1);
+	done &= stream_write_primitive(s, &scheduler->stats.wait_max, 4);
+
+	done &= stream_write_primitive(s, &server->udp.stats.received, 4);
+	done &= stream_write_primitive(s, &server->udp.stats.duplicates, 4);
+	done &= stream_write_primitive(s, &server->udp.stats.malformed, 4);
+	done &= stream_write_primitive(s, &server->stats.dropped, 4);
+	done &= stream_write_primitive(s, &server->rules.stats.captures, 4);
+	done &= stream_write_primitive(s, &server->rules.stats.matches, 4);
+	done &= stream_write_primitive(s, &server->rules.stats.failed, 4);
+
+	i = 0;
+	done &= stream_write_primitive(s, &types, 1);
+	while (i < types) done &= stream_write_primitive(s, &server->stats.requests[i++], 4);
+
+	done &= stream_write_primitive(s, &states, 1);
+	done &= stream_write_primitive(s, &buckets, 1);
+	done &= stream_write_primitive(s, &shift, 1);
+	i = 0;
+	while (i < states) {
+		// histograms go out one state at a time, the whole answer does not fit the out buffer
+		if (stream_left(s) < 4 * buckets) {
+			if (!send_buffer(worker)) return false;
+		}
+		uint8_t j = 0;
+		while (j < buckets) done &= stream_write_primitive(s, &server->stats.states[i][j++], 4);
+		i++;
+	}
+	if (stream_left(s) < 4 * 4) {
+		if (!send_buffer(worker)) return false;
+	}
+	done &= stream_write_primitive(s, &server->limiter.stats.limited, 4);
+	done &= stream_write_primitive(s, &server->limiter.stats.evicted, 4);
+	done &= stream_write_primitive(s, &server->udp.stats.limited, 4);
+	done &= stream_write_primitive(s, &server->udp.stats.offline, 4);
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_time_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// taken as late as possible, the answer leaves right after
+	uint64_t now = ir_scheduler_clock(&worker->server->scheduler);
+	if (!write_response_head(worker, IR_TIME_RESPONSE, 8)) return false;
+	if (!stream_write_primitive(&worker->out, &now, 8)) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_probe_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	uint16_t size = stack_buffer_size(&worker->buffer);
+	uint16_t length = 2 * (1 + 5 * 4) + size;
+	if (!write_response_head(worker, IR_PROBE_RESPONSE, length)) return false;
+
+	// our own steps first, then those of the previous request on this connection
+	worker->timing.queued = system_get_time();
+	ir_timing_t* timings[] = {&worker->timing, &worker->last};
+	stream_t* s = &worker->out;
+	bool done = true;
+	uint8_t i = 0;
+	while (i < 2) {
+		ir_timing_t* timing = timings[i++];
+		done &= stream_write_primitive(s, &timing->type, 1);
+		done &= stream_write_primitive(s, &timing->arrived, 4);
+		done &= stream_write_primitive(s, &timing->parsed, 4);
+		done &= stream_write_primitive(s, &timing->processing, 4);
+		done &= stream_write_primitive(s, &timing->processed, 4);
+		done &= stream_write_primitive(s, &timing->queued, 4);
+	}
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	if (!send_buffer(worker)) return false;
+
+	if (size <= 0) return true;
+	if (!socket_queue(worker->socket, worker->buffer.start, size, NULL, NULL)) {
+		worker_stop(worker);
+		return false;
+	}
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR write_hello_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	// request types read_request accepts, announced as a bitmap indexed by type
+	static const uint8_t requests[] = {
+		IR_SEND_REQUEST, IR_RECEIVE_REQUEST, IR_CONFIG_REQUEST, IR_BATCH_SEND_REQUEST,
+		IR_LIBRARY_PUT_REQUEST, IR_LIBRARY_DELETE_REQUEST, IR_LIBRARY_LIST_REQUEST, IR_LIBRARY_SEND_REQUEST,
+		IR_SEQUENCE_PUT_REQUEST, IR_SEQUENCE_RUN_REQUEST, IR_SEQUENCE_CANCEL_REQUEST, IR_RULE_PUT_REQUEST,
+		IR_SUBSCRIBE_REQUEST, IR_STATS_REQUEST, IR_TIME_REQUEST, IR_PROBE_REQUEST, IR_HELLO_REQUEST,
+		IR_CANCEL_REQUEST
+	};
+	uint8_t map[(IR_PACKET_TYPES + 7) / 8];
+	m_memset(map, 0, sizeof(map));
+	uint8_t i = 0;
+	while (i < sizeof(requests)) {
+		uint8_t type = requests[i++];
+		map[type / 8] |= 1 << (type % 8);
+	}
+
+	uint8_t version = IR_PROTOCOL_VERSION;
+	uint8_t server = SERVER_VERSION;
+	uint8_t time_length = IR_TIME_LENGTH;
+	uint16_t times = IR_TIMES_MAX;
+	uint16_t buffer = IR_BUFFER_LENGTH;
+	uint16_t segment = IR_PENDING_LENGTH;
+	uint8_t encodings = IR_ENCODING_BINARY | IR_ENCODING_TEXT;
+	uint16_t features = IR_FEATURES;
+	uint8_t workers = 1;
+	uint8_t subscribers = IR_SUBSCRIBERS;
+	uint8_t batch = IR_BATCH_ITEMS_MAX;
+	uint8_t frames = IR_RECEIVE_FRAMES_MAX;
+	uint16_t at = IR_SEND_AT_MAX;
+	uint8_t types = sizeof(map);
+	uint16_t length = 3 + 3 * 2 + 1 + 2 + 4 + 2 + 1 + types;
+
+	if (!write_response_head(worker, IR_HELLO_RESPONSE, length)) return false;
+	stream_t* s = &worker->out;
+	bool done = true;
+	done &= stream_write_primitive(s, &version, 1);
+	done &= stream_write_primitive(s, &server, 1);
+	done &= stream_write_primitive(s, &time_length, 1);
+	done &= stream_write_primitive(s, &times, 2);
+	done &= stream_write_primitive(s, &buffer, 2);
+	done &= stream_write_primitive(s, &segment, 2);
+	done &= stream_write_primitive(s, &encodings, 1);
+	done &= stream_write_primitive(s, &features, 2);
+	done &= stream_write_primitive(s, &workers, 1);
+	done &= stream_write_primitive(s, &subscribers, 1);
+	done &= stream_write_primitive(s, &batch, 1);
+	done &= stream_write_primitive(s, &frames, 1);
+	done &= stream_write_primitive(s, &at, 2);
+	done &= stream_write_primitive(s, &types, 1);
+	done &= stream_write(s, map, types);
+	if (!done) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR write_cancel_response(ir_worker_t* worker) {
+	DEBUG_FUNCTION_START();
+
+	if (!write_response_head(worker, IR_CANCEL_RESPONSE, 1)) return false;
+	if (!stream_write_primitive(&worker->out, &worker->process.cancel.count, 1)) {
+		DEBUG_FUNCTION("buffer too small");
+		worker_stop(worker);
+		return false;
+	}
+	return send_buffer(worker);
+}
+
+static bool ICACHE_FLASH_ATTR finish(ir_worker_t* worker) {
+	switch (worker->request.type) {
+	case IR_CONFIG_REQUEST:
+	case IR_LIBRARY_PUT_REQUEST:
+	case IR_LIBRARY_DELETE_REQUEST:
+	case IR_SEQUENCE_PUT_REQUEST:
+	case IR_RULE_PUT_REQUEST:
+		// clients caching the configuration learn about the change from the next beacon
+		if (worker->response.status == IR_STATUS_OK) worker->server->generation++;
+		break;
+	}
+
+	switch (worker->request.type) {
+	case IR_SEND_REQUEST:
+	case IR_BATCH_SEND_REQUEST:
+		return true;
+	case IR_RECEIVE_REQUEST:
+		// capture is done, the receiver goes back to the rules
+		receive_release(worker);
+		return true;
+	case IR_CONFIG_REQUEST:
+		return finish_config(worker);
+	case IR_LIBRARY_PUT_REQUEST:
+	case IR_LIBRARY_DELETE_REQUEST:
+	case IR_LIBRARY_LIST_REQUEST:
+	case IR_LIBRARY_SEND_REQUEST:
+	case IR_SEQUENCE_PUT_REQUEST:
+	case IR_SEQUENCE_RUN_REQUEST:
+	case IR_SEQUENCE_CANCEL_REQUEST:
+	case IR_RULE_PUT_REQUEST:
+	case IR_STATS_REQUEST:
+	case IR_TIME_REQUEST:
+	case IR_PROBE_REQUEST:
+	case IR_HELLO_REQUEST:
+	case IR_CANCEL_REQUEST:
+		return true;
+	case IR_SUBSCRIBE_REQUEST:
+		return finish_subscribe(worker);
+	default:
+		DEBUG_FUNCTION("illegal request");
+		worker_stop(worker);
+		return false;
+	}
+
+	return false;
+}
+
+static bool ICACHE_FLASH_ATTR finish_config(ir_worker_t* worker) {
+	ir_server_t* server = worker->server;
+
+	beacon_pack(server);
+	beacon_announce(&server->beacon);
+	if (server->config_cb != NULL) {
+		server->config_cb(server, &worker->request.config.ssid, &worker->request.config.password);
+	}
+
+	return true;
+}
+
+static bool ICACHE_FLASH_ATTR finish_subscribe(ir_worker_t* worker) {
+	if (worker->response.status != IR_STATUS_OK) return true;
+
+	ir_server_t* server = worker->server;
+	ir_subscriber_t* subscriber = subscriber_alloc(server);
+	if (subscriber == NULL) return true;
+
+	// the connection leaves the worker, which is free for the next client
+	socket_t* socket = worker->socket;
+	if (worker->held) socket_unhold(socket);
+	worker->held = false;
+	worker->socket = NULL;
+	worker->persistent = false;
+
+	subscriber->socket = socket;
+	subscriber->server = server;
+	subscriber->filter = worker->request.subscribe.filter;
+	subscriber->key = worker->request.subscribe.key;
+	subscriber->queued = 0;
+	subscriber->dropped = 0;
+	subscriber->used = true;
+
+	socket->reverse = subscriber;
+	socket->receive_cb = subscriber_receive;
+	socket->sent_cb = subscriber_sent;
+	socket->disconnect_cb = subscriber_disconnect;
+	socket->error_cb = subscriber_error;
+
+	ir_rules_watch(&server->rules, true);
+	return true;
+}
+
+static void connect(server_socket_t* server, socket_t* client) {
+	ir_server_t* ir_server = (ir_server_t*) server->reverse;
+	if ((ir_server->worker.socket != NULL) || (ir_server->worker.state != IR_WORKER_READY)) {
+		ir_server->stats.refused++;
+		socket_close(client);
+		return;
+	}
+
+	ir_server->worker.socket = client;
+	uint16_t port;
+	if (!socket_remote(client, ir_server->worker.ip, &port)) m_memset(ir_server->worker.ip, 0, 4);
+	// refused only at the first request, the client gets a busy answer instead of a bare close
+	ir_server->worker.retry = ir_limiter_take(&ir_server->limiter, ir_server->worker.ip, IR_LIMIT_CONNECT);
+	do {
+		ir_server->clients++;
+	} while ((ir_server->clients == IR_SCHEDULER_CLIENT_NONE) || (ir_server->clients >= IR_SCHEDULER_CLIENT_RESERVED));
+	ir_server->worker.client = ir_server->clients;
+
+	client->flush_delay = IR_FLUSH_DELAY;
+	client->reverse = &ir_server->worker;
+	client->receive_cb = receive;
+	client->sent_cb = sent;
+	client->disconnect_cb = disconnect;
+
+	// a connection that never sends anything must not hold the worker
+	worker_phase(&ir_server->worker, IR_PHASE_HEADER);
+}
+
+static void receive(socket_t* client, uint8_t* data, uint16_t length) {
+	DEBUG_FUNCTION_START();
+	DEBUG("tcp length %d", length);
+
+	ir_worker_t* worker = (ir_worker_t*) client->reverse;
+	if (stack_buffer_size(&worker->pending) > 0) {
+		// keep the order behind data that is still waiting
+		if (length > stack_buffer_left(&worker->pending)) {
+			DEBUG_FUNCTION("pending overflow");
+			worker_stop(worker);
+			return;
+		}
+		stack_buffer_pushn(&worker->pending, data, length);
+		worker_intercept(worker);
+		return;
+	}
+
+	worker->arrived = system_get_time();
+	stream_data(&worker->in, data, length);
+	worker_feed(worker);
+}
+
+static void sent(socket_t* client) {
+	ir_worker_t* worker = (ir_worker_t*) client->reverse;
+	if (!socket_idle(client)) return;
+	worker_run(worker);
+}
+
+static void disconnect(socket_t* client) {
+	ir_worker_t* worker = (ir_worker_t*) client->reverse;
+	// the callback of a connection the worker already closed comes late, the worker may serve the next one
+	if (worker->socket != client) return;
+
+	// the receiver and the transmitter are free at once, the reset follows from the timer
+	worker_cancel(worker);
+	worker_stop(worker);
+}
+
+static void sequence_progress(ir_sequencer_t* sequencer, ir_job_result_t result, bool done) {
+	ir_server_t* server = (ir_server_t*) sequencer->reverse;
+	ir_worker_t* worker = &server->worker;
+	if (sequencer->owner == IR_SCHEDULER_CLIENT_NONE) return;
+	if (sequencer->owner != worker->client) return;
+	if (worker->socket == NULL) return;
+
+	uint8_t body[3] = {sequencer->index, sequencer->count, done};
+	write_message(worker, IR_SEQUENCE_PROGRESS, sequencer->tag, job_status(result), body, sizeof(body));
+}
+
+static void rule_notify(ir_rules_t* rules, ir_rule_t* rule, uint32_t key) {
+	ir_server_t* server = (ir_server_t*) rules->reverse;
+	ir_worker_t* worker = &server->worker;
+	if (!worker->persistent || worker->http) return;
+	if (worker->socket == NULL) return;
+
+	uint8_t body[5] = {rule->match, key >> 24, key >> 16, key >> 8, key};
+	write_message(worker, IR_RULE_EVENT, rule->id, IR_STATUS_OK, body, sizeof(body));
+}
+
+static void capture_publish(ir_rules_t* rules, uint16_t* times, uint16_t count, uint32_t fingerprint, bool nec, uint32_t code) {
+	ir_server_t* server = (ir_server_t*) rules->reverse;
+	ir_event_t* event = NULL;
+
+	uint8_t i = 0;
+	while (i < IR_SUBSCRIBERS) {
+		ir_subscriber_t* subscriber = &server->subscribers[i++];
+		if (!subscriber->used) continue;
+		if (!subscriber_wants(subscriber, fingerprint, nec, code)) continue;
+		// a slow subscriber loses frames instead of piling up memory
+		if (subscriber->queued >= IR_SUBSCRIBER_QUEUE_MAX) {
+			subscriber->dropped++;
+			server->stats.dropped++;
+			continue;
+		}
+
+		if (event == NULL) {
+			// serialized once, every subscriber queues the same bytes
+			uint16_t length = IR_HEAD_LENGTH + 4 + 1 + 4 + 2 + IR_TIME_LENGTH * count;
+			event = (ir_event_t*) m_malloc(sizeof(ir_event_t) + length);
+			if (event == NULL) return;
+			event->references = 1;
+			event->length = length;
+
+			stream_t s;
+			stream_create(&s);
+			s.swap_endian = IR_SWAP_ENDIAN;
+			stack_buffer_create(&s.buffer, event->data, length);
+			write_head(&s, IR_PROTOCOL_VERSION, IR_RECEIVE_EVENT, 0, 0, IR_STATUS_OK, length - IR_HEAD_LENGTH);
+			stream_write_primitive(&s, &fingerprint, 4);
+			stream_write_primitive(&s, &nec, 1);
+			stream_write_primitive(&s, &code, 4);
+			stream_write_primitive(&s, &count, 2);
+			uint8_t* payload = s.buffer.position;
+			m_memcpy(payload, times, IR_TIME_LENGTH * count);
+			if (IR_SWAP_ENDIAN) array_swap_endian(payload, IR_TIME_LENGTH, count);
+		}
+
+		event->references++;
+		subscriber->queued++;
+		if (!socket_queue(subscriber->socket, event->data, event->length, event_release, event)) {
+			event->references--;
+			subscriber->queued--;
+			subscriber->dropped++;
+			server->stats.dropped++;
+		}
+	}
+
+	if (event != NULL) event_release(NULL, event);
+}
+
+static void ICACHE_FLASH_ATTR event_release(socket_t* client, void* reverse) {
+	ir_event_t* event = (ir_event_t*) reverse;
+	if (client != NULL) {
+		ir_subscriber_t* subscriber = (ir_subscriber_t*) client->reverse;
+		if ((subscriber != NULL) && (subscriber->queued > 0)) subscriber->queued--;
+	}
+	if (--event->references <= 0) m_free(event);
+}
+
+static ir_subscriber_t* ICACHE_FLASH_ATTR subscriber_alloc(ir_server_t* server) {
+	uint8_t i = 0;
+	while (i < IR_SUBSCRIBERS) {
+		ir_subscriber_t* subscriber = &server->subscribers[i++];
+		if (!subscriber->used) return subscriber;
+	}
+	return NULL;
+}
+
+static bool ICACHE_FLASH_ATTR subscriber_wants(ir_subscriber_t* subscriber, uint32_t fingerprint, bool nec, uint32_t code) {
+	switch (subscriber->filter) {
+	case IR_FILTER_ALL:
+		return true;
+	case IR_FILTER_FINGERPRINT:
+		return subscriber->key == fingerprint;
+	case IR_FILTER_NEC:
+		return nec;
+	case IR_FILTER_NEC_CODE:
+		return nec && (subscriber->key == code);
+	}
+	return false;
+}
+
+static void subscriber_receive(socket_t* client, uint8_t* data, uint16_t length) {
+	// nothing is expected from subscribers, closing the connection ends the subscription
+	DEBUG_FUNCTION("ignored");
+}
+
+static void subscriber_sent(socket_t* client) {
+}
+
+static void subscriber_disconnect(socket_t* client) {
+	ir_subscriber_t* subscriber = (ir_subscriber_t*) client->reverse;
+	if (!subscriber->used) return;
+
+	// queued events were released when the socket was cleared
+	subscriber->used = false;
+	subscriber->socket = NULL;
+	client->reverse = NULL;
+	ir_rules_watch(&subscriber->server->rules, false);
+}
+
+static void subscriber_error(socket_t* client, int8_t error) {
+	DEBUG("subscriber error %d", error);
+	subscriber_disconnect(client);
 }
 
 static void signal_received(signal_station_t* station) {
@@ -8,6 +8,13 @@
 
 #include "util.h"
 #include "signal.h"
+#include "scheduler.h"
+#include "udp.h"
+#include "library.h"
+#include "sequence.h"
+#include "rules.h"
+#include "limiter.h"
+#include "http.h"
 #include "network/socket.h"
 #include "network/beacon.h"
 
@@ -16,35 +23,109 @@
 
 #define IR_DEFAULT_PORT 1234
 
+#define IR_PROTOCOL_VERSIONED 0x80
+#define IR_PROTOCOL_VERSION 2
+#define IR_HEAD_LENGTH 8
+#define IR_MESSAGE_LENGTH_MAX 8
+
+#define IR_FLAG_ASYNC 0x01
+#define IR_FLAG_STREAM 0x02
+#define IR_FLAG_AT 0x04
+
+// announced in the hello response
+#define IR_FEATURE_ASYNC 0x0001
+#define IR_FEATURE_STREAM 0x0002
+#define IR_FEATURE_AT 0x0004
+#define IR_FEATURE_FRAMED_RECEIVE 0x0008
+#define IR_FEATURE_LIBRARY 0x0010
+#define IR_FEATURE_SEQUENCE 0x0020
+#define IR_FEATURE_RULES 0x0040
+#define IR_FEATURE_SUBSCRIBE 0x0080
+#define IR_FEATURE_HTTP 0x0100
+#define IR_FEATURE_CANCEL 0x0200
+#define IR_FEATURES (IR_FEATURE_ASYNC | IR_FEATURE_STREAM | IR_FEATURE_AT | IR_FEATURE_FRAMED_RECEIVE \
+		| IR_FEATURE_LIBRARY | IR_FEATURE_SEQUENCE | IR_FEATURE_RULES | IR_FEATURE_SUBSCRIBE | IR_FEATURE_HTTP \
+		| IR_FEATURE_CANCEL)
+
+#define IR_ENCODING_BINARY 0x01
+#define IR_ENCODING_TEXT 0x02
+
 #define IR_DELAY_SOON 20
 
 #define IR_TIME_LENGTH 2
-#define IR_TIMES_MAX 128
+// long air conditioner frames, several received frames and both stream blocks fit the worker buffer
+#define IR_TIMES_MAX 512
 
 #define IR_SWAP_ENDIAN true
 
 #define IR_BUFFER_LENGTH (IR_TIMES_MAX * IR_TIME_LENGTH)
 #define IR_SEND_BUFFER_LENGTH 1024
+#define IR_FLUSH_DELAY 5
+// one whole segment must fit, the socket is only held after it arrived
+#define IR_PENDING_LENGTH SOCKET_SEGMENT_LENGTH_MAX
 
 #define IR_GPIO_RECEIVE 2
 #define IR_GPIO_SEND 0
 #define IR_TIMEOUT_SIGNAL 100000
 #define IR_TIMEOUT_PULSE 10000
+#define IR_SEND_DEADLINE 1000
+#define IR_SEND_AT_MAX 20000
+
+#define IR_STREAM_BLOCKS 2
+#define IR_STREAM_BLOCK_LENGTH (IR_BUFFER_LENGTH / IR_STREAM_BLOCKS)
+#define IR_STREAM_YIELD 5000
+
+#define IR_RECEIVE_FRAMES_MAX 8
+#define IR_RECEIVE_GAP_MAX 65
+// an http receive without a wait in its query must not hold the worker forever
+#define IR_HTTP_RECEIVE_WAIT 10000
+
+#define IR_TIMEOUT_IDLE 60000
+#define IR_TIMEOUT_HEADER 5000
+#define IR_TIMEOUT_BODY 10000
+#define IR_TIMEOUT_PROCESS 30000
+#define IR_TIMEOUT_RESPONSE 10000
+
+#define IR_BATCH_ITEMS_MAX 20
+
+#define IR_LIBRARY_ADDRESS 0x3E000
+
+#define IR_SUBSCRIBERS 4
+#define IR_SUBSCRIBER_QUEUE_MAX 4
+
+// log2 buckets of microseconds, the first one takes everything below 2^IR_STATS_SHIFT
+#define IR_STATS_BUCKETS 16
+#define IR_STATS_SHIFT 7
 
 #define IR_NAME_LENGTH_MAX 32
 
 #define IR_BEACON_PORT 8888
 #define IR_BEACON_INTERVAL 1000
+#define IR_BEACON_INTERVAL_MAX 300000
+// never a prefix of an announcement, those start with the port and a name length of at most IR_NAME_LENGTH_MAX
+#define IR_BEACON_QUERY "IR?"
 #define IR_BEACON_HEAD_LENGTH 3
-#define IR_BEACON_LENGTH_MAX (IR_BEACON_HEAD_LENGTH + IR_NAME_LENGTH_MAX)
+// load, queue depth, rssi, uptime, features and config generation follow the name
+#define IR_BEACON_FIELDS_LENGTH 11
+#define IR_BEACON_LENGTH_MAX (IR_BEACON_HEAD_LENGTH + IR_NAME_LENGTH_MAX + IR_BEACON_FIELDS_LENGTH)
+
+// milliseconds a client is told to wait while the station has no address
+#define IR_OFFLINE_RETRY 1000
 
 
 typedef enum ir_packet_type ir_packet_type_t;
+typedef enum ir_status ir_status_t;
 typedef enum ir_worker_state ir_worker_state_t;
+typedef enum ir_phase ir_phase_t;
+typedef enum ir_filter ir_filter_t;
 
 typedef struct ir_server ir_server_t;
 typedef struct ir_beacon ir_beacon_t;
 typedef struct ir_worker ir_worker_t;
+typedef struct ir_batch_item ir_batch_item_t;
+typedef struct ir_subscriber ir_subscriber_t;
+typedef struct ir_event ir_event_t;
+typedef struct ir_timing ir_timing_t;
 
 typedef void (*ir_config_cb_t) (ir_server_t* server, string_t* ssid, string_t* password);
 
@@ -55,7 +136,52 @@ enum ir_packet_type {
 	IR_RECEIVE_REQUEST,
 	IR_RECEIVE_RESPONSE,
 	IR_CONFIG_REQUEST,
-	IR_CONFIG_RESPONSE
+	IR_CONFIG_RESPONSE,
+	IR_BATCH_SEND_REQUEST,
+	IR_ERROR_RESPONSE,
+	IR_LIBRARY_PUT_REQUEST,
+	IR_LIBRARY_PUT_RESPONSE,
+	IR_LIBRARY_DELETE_REQUEST,
+	IR_LIBRARY_DELETE_RESPONSE,
+	IR_LIBRARY_LIST_REQUEST,
+	IR_LIBRARY_LIST_RESPONSE,
+	IR_LIBRARY_SEND_REQUEST,
+	IR_SEQUENCE_PUT_REQUEST,
+	IR_SEQUENCE_RUN_REQUEST,
+	IR_SEQUENCE_RUN_RESPONSE,
+	IR_SEQUENCE_PROGRESS,
+	IR_SEQUENCE_CANCEL_REQUEST,
+	IR_SEQUENCE_CANCEL_RESPONSE,
+	IR_RULE_PUT_REQUEST,
+	IR_RULE_EVENT,
+	IR_SUBSCRIBE_REQUEST,
+	IR_SUBSCRIBE_RESPONSE,
+	IR_RECEIVE_EVENT,
+	IR_STATS_REQUEST,
+	IR_STATS_RESPONSE,
+	IR_TIME_REQUEST,
+	IR_TIME_RESPONSE,
+	IR_PROBE_REQUEST,
+	IR_PROBE_RESPONSE,
+	IR_HELLO_REQUEST,
+	IR_HELLO_RESPONSE,
+	IR_CANCEL_REQUEST,
+	IR_CANCEL_RESPONSE,
+	IR_PACKET_TYPES
+};
+
+enum ir_status {
+	IR_STATUS_OK,
+	IR_STATUS_ERROR,
+	IR_STATUS_MALFORMED,
+	IR_STATUS_UNSUPPORTED,
+	IR_STATUS_OVERFLOW,
+	IR_STATUS_BUSY,
+	IR_STATUS_TIMEOUT,
+	IR_STATUS_EXPIRED,
+	IR_STATUS_CANCELLED,
+	IR_STATUS_REJECTED,
+	IR_STATUS_NOT_FOUND
 };
 
 enum ir_worker_state {
@@ -63,38 +189,140 @@ enum ir_worker_state {
 	IR_WORKER_REQUEST,
 	IR_WORKER_PROCESS,
 	IR_WORKER_RESPONSE,
-	IR_WORKER_FINISH
+	IR_WORKER_FINISH,
+	IR_WORKER_STATES
+};
+
+enum ir_phase {
+	IR_PHASE_IDLE,
+	IR_PHASE_HEADER,
+	IR_PHASE_BODY,
+	IR_PHASE_PROCESS,
+	IR_PHASE_RESPONSE,
+	IR_PHASES
+};
+
+enum ir_filter {
+	IR_FILTER_ALL,
+	IR_FILTER_FINGERPRINT,
+	IR_FILTER_NEC,
+	IR_FILTER_NEC_CODE
+};
+
+struct ir_subscriber {
+	socket_t* socket;
+	ir_server_t* server;
+
+	uint8_t filter;
+	uint32_t key;
+
+	uint8_t queued;
+	uint32_t dropped;
+	bool used;
+};
+
+// one serialized frame shared by all subscribers, freed with the last reference
+struct ir_event {
+	uint8_t references;
+	uint16_t length;
+	uint8_t data[];
+};
+
+// system time in microseconds at each step of a request
+struct ir_timing {
+	uint8_t type;
+	uint32_t arrived;
+	uint32_t parsed;
+	uint32_t processing;
+	uint32_t processed;
+	uint32_t queued;
+};
+
+struct ir_batch_item {
+	uint32_t frequency;
+	uint8_t repeat;
+	uint16_t delay;
+	stack_buffer_t times;
+	uint8_t result;
 };
 
 struct ir_worker {
 	socket_t* socket;
 	ir_server_t* server;
+	uint16_t client;
+	uint8_t ip[4];
+	// milliseconds a busy answer tells the client to back off, set when the connection was over its limit
+	uint16_t retry;
 
 	stream_t in;
 	stream_t out;
 	stack_buffer_t buffer;
+	stack_buffer_t pending;
+	bool held;
+	uint32_t arrived;
+	uint32_t pending_arrived;
 
 	ir_worker_state_t state;
-	bool send_lock;
+	uint32_t entered;
+	bool persistent;
+	bool http;
+	bool stopping;
 	os_timer_t timer;
+	ir_phase_t phase;
+	os_timer_t timeout;
+	ir_timing_t timing;
+	ir_timing_t last;
+
+	struct {
+		bool active;
+		bool done;
+		bool starved;
+		stack_buffer_t blocks[IR_STREAM_BLOCKS];
+		bool ready[IR_STREAM_BLOCKS];
+		uint8_t block;
+		signal_station_t saved;
+		os_timer_t timer;
+	} stream;
 
 	struct {
+		uint8_t version;
 		uint8_t type;
+		uint16_t id;
+		uint8_t flags;
 		uint16_t length;
 
 		uint8_t state;
 		uint16_t read;
+		ir_http_t http;
 
 		union {
 			struct {
 				uint8_t state;
 
+				uint64_t at;
 				uint32_t frequency;
 				uint16_t length;
+				stack_buffer_t times;
+				bool owned;
 
-				uint16_t read;
+				bool stream;
+				uint16_t received;
+				uint8_t fill;
 			} send;
 			struct {
+				uint8_t state;
+
+				uint8_t count;
+				uint8_t index;
+				uint16_t length;
+			} batch;
+			struct {
+				uint8_t state;
+
+				bool framed;
+				uint16_t wait;
+				uint8_t frames;
+				uint16_t gap;
 			} receive;
 			struct {
 				uint8_t state;
@@ -104,6 +332,27 @@ struct ir_worker {
 
 				uint8_t length;
 			} config;
+			struct {
+				uint8_t state;
+
+				uint16_t id;
+				uint8_t name_length;
+				uint8_t name[IR_LIBRARY_NAME_LENGTH_MAX];
+				uint32_t frequency;
+				uint16_t length;
+				uint8_t count;
+				uint8_t index;
+			} library;
+			struct {
+				uint8_t state;
+
+				uint8_t filter;
+				uint32_t key;
+			} subscribe;
+			struct {
+				bool targeted;
+				uint16_t target;
+			} cancel;
 		};
 	} request;
 
@@ -112,29 +361,43 @@ struct ir_worker {
 
 		union {
 			struct {
+				uint8_t state;
+				ir_job_result_t result;
 			} send;
 			struct {
 				uint8_t state;
+				uint8_t index;
+			} batch;
+			struct {
+				uint8_t state;
+				bool timeout;
+
+				uint8_t count;
+				uint16_t sizes[IR_RECEIVE_FRAMES_MAX];
 			} receive;
 			struct {
 			} config;
+			struct {
+				uint8_t count;
+			} cancel;
 		};
 	} process;
 
 	struct {
 		uint8_t state;
+		uint8_t status;
 
 		union {
 			struct {
 			} send;
 			struct {
-				uint8_t state;
-				uint16_t written;
 			} receive;
 			struct {
 			} config;
 		};
 	} response;
+
+	ir_batch_item_t batch[IR_BATCH_ITEMS_MAX];
 };
 
 struct ir_server {
@@ -142,11 +405,44 @@ struct ir_server {
 
 	beacon_t beacon;
 	stream_t beacon_out;
+	// values last packed into the beacon, only those that changed are written again
+	struct {
+		uint16_t offset;
+		uint8_t load;
+		uint8_t depth;
+		sint8 rssi;
+		uint32_t uptime;
+		uint16_t generation;
+	} beacon_fields;
+	uint16_t generation;
 
 	ir_worker_t worker;
 	signal_station_t station;
+	ir_scheduler_t scheduler;
+	uint16_t clients;
+	ir_udp_t udp;
+	ir_library_t library;
+	ir_sequencer_t sequencer;
+	ir_rules_t rules;
+	ir_subscriber_t subscribers[IR_SUBSCRIBERS];
+	ir_limiter_t limiter;
+
+	struct {
+		uint32_t limit[IR_PHASES];
+		uint32_t fired[IR_PHASES];
+	} timeout;
+
+	struct {
+		uint32_t requests[IR_PACKET_TYPES];
+		uint32_t refused;
+		uint32_t overflows;
+		uint32_t dropped;
+		uint32_t heap_min;
+		uint32_t states[IR_WORKER_STATES][IR_STATS_BUCKETS];
+	} stats;
 
 	bool running;
+	bool online;
 	stack_buffer_t name;
 
 	ir_config_cb_t config_cb;
@@ -157,10 +453,14 @@ ir_server_t* ir_server_create(ir_server_t* server, uint16_t port);
 void ir_server_destroy(ir_server_t* server, bool all);
 void ir_server_start(ir_server_t* server);
 void ir_server_stop(ir_server_t* server);
+void ir_server_timeout(ir_server_t* server, ir_phase_t phase, uint32_t timeout);
+bool ir_server_idle(ir_server_t* server);
+void ir_server_network(ir_server_t* server, bool online);
 
 ir_worker_t* ir_worker_create(ir_worker_t* worker, ir_server_t* server, socket_t* socket);
 void ir_worker_destroy(ir_worker_t* worker, bool all);
 void ir_worker_reset(ir_worker_t* worker);
+void ir_worker_next(ir_worker_t* worker);
 
 
 #endif /* SERVER_H_ */
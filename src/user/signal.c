@@ -75,17 +75,17 @@ static void mark(signal_station_t* station, uint32_t time) {
 }
 
 static bool ICACHE_FLASH_ATTR time_read(signal_station_t* station, uint32_t* time) {
-	if (station->position >= signal_station_length(station)) return false;
+	if (station->position >= signal_station_size(station)) return false;
 
 	switch (station->time_length) {
 	case 1:
-		*time = ((uint8_t*) station->times.start)[station->position];
+		*time = ((uint8_t*) station->times->start)[station->position];
 		break;
 	case 2:
-		*time = ((uint16_t*) station->times.start)[station->position];
+		*time = ((uint16_t*) station->times->start)[station->position];
 		break;
 	case 4:
-		*time = ((uint32_t*) station->times.start)[station->position];
+		*time = ((uint32_t*) station->times->start)[station->position];
 		break;
 	default:
 		DEBUG_FUNCTION("illegal time length");
@@ -97,24 +97,25 @@ static bool ICACHE_FLASH_ATTR time_read(signal_station_t* station, uint32_t* tim
 }
 
 static bool ICACHE_FLASH_ATTR time_write(signal_station_t* station, uint32_t* time) {
-	if (station->position >= signal_station_length(station)) return false;
+	// captures may append to what is already in the buffer
+	if (stack_buffer_left(station->times) < station->time_length) return false;
 
 	switch (station->time_length) {
 	case 1:
-		*((uint8_t*) station->times.position) = *time;
+		*((uint8_t*) station->times->position) = *time;
 		break;
 	case 2:
-		*((uint16_t*) station->times.position) = *time;
+		*((uint16_t*) station->times->position) = *time;
 		break;
 	case 4:
-		*((uint32_t*) station->times.position) = *time;
+		*((uint32_t*) station->times->position) = *time;
 		break;
 	default:
 		DEBUG_FUNCTION("illegal time length");
 		return false;
 	}
 
-	station->times.position += station->time_length;
+	station->times->position += station->time_length;
 	station->position++;
 	return true;
 }
@@ -124,6 +125,8 @@ signal_station_t* ICACHE_FLASH_ATTR signal_station_create(signal_station_t* stat
 
 	station->signal_timeout = DEFAULT_SIGNAL_TIMEOUT;
 	station->pulse_timeout = DEFAULT_PULSE_TIMEOUT;
+	station->receiving = false;
+	station->overflows = 0;
 
 	return station;
 }
@@ -134,6 +137,10 @@ void ICACHE_FLASH_ATTR signal_station_destry(signal_station_t* station, bool all
 
 void ICACHE_FLASH_ATTR signal_station_reset(signal_station_t* station) {
 	ETS_GPIO_INTR_DISABLE();
+	// the pin itself is disarmed as well, the next global enable must not fire on a stale edge
+	gpio_pin_intr_state_set(station->gpio_id, GPIO_PIN_INTR_DISABLE);
+	GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, BIT(station->gpio));
+	station->receiving = false;
 }
 
 void ICACHE_FLASH_ATTR signal_send(signal_station_t* station) {
@@ -150,6 +157,26 @@ void ICACHE_FLASH_ATTR signal_send(signal_station_t* station) {
 	}
 }
 
+void ICACHE_FLASH_ATTR signal_send_begin(signal_station_t* station) {
+	init_out(station);
+	station->sent = 0;
+}
+
+// sends from the current position until the times run out or a space of at least yield comes up;
+// that space is returned instead of waited for, the caller waits it out and calls again
+uint32_t ICACHE_FLASH_ATTR signal_send_part(signal_station_t* station, uint32_t yield) {
+	uint32_t time;
+	while (time_read(station, &time)) {
+		if ((station->sent++ & 1) == 0) {
+			mark(station, time);
+			continue;
+		}
+		if (time >= yield) return time;
+		space(station, time);
+	}
+	return 0;
+}
+
 void ICACHE_FLASH_ATTR signal_receive(signal_station_t* station) {
 	DEBUG_FUNCTION_START();
 	init_in(station);
@@ -160,7 +187,6 @@ void ICACHE_FLASH_ATTR signal_receive(signal_station_t* station) {
 	uint32_t last = start;
 	uint32_t now;
 	uint32_t time;
-	uint16_t i = 0;
 
 	while (true) {
 		read = gpio_read(station);
@@ -177,13 +203,12 @@ void ICACHE_FLASH_ATTR signal_receive(signal_station_t* station) {
 			break;
 		}
 		if (read == current) continue;
-		if (i >= signal_station_length(station)) {
+		if (!time_write(station, &time)) {
 			DEBUG_FUNCTION("buffer overflow");
-			// TODO: error
+			station->overflows++;
 			break;
 		}
 
-		time_write(station, &time);
 		last = now;
 		current = read;
 	}
@@ -201,6 +226,7 @@ void ICACHE_FLASH_ATTR signal_receive_next(signal_station_t* station) {
 	ETS_GPIO_INTR_ATTACH(gpio_callback, station); //(uint32_t) station->gpio
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_GPIO2_U, FUNC_GPIO2);
 	gpio_pin_intr_state_set(station->gpio_id, GPIO_PIN_INTR_ANYEGDE);
+	station->receiving = true;
 	ETS_GPIO_INTR_ENABLE();
 }
 
@@ -209,6 +235,7 @@ static void gpio_callback(void* arg) {
 	ETS_GPIO_INTR_DISABLE();
 
 	signal_station_t* station = (signal_station_t*) arg;
+	station->receiving = false;
 	signal_receive(station);
 	station->received_cb(station);
 }
@@ -0,0 +1,198 @@
+
+#include "udp.h"
+
+#include "osapi.h"
+
+#include "memory.h"
+#include "util.h"
+#include "server.h"
+#include "network/socket.h"
+
+#include "debug/debug_on.h"
+
+
+static ir_udp_peer_t* peer_get(ir_udp_t* udp, uint8_t* ip, bool create);
+static void send_ack(ir_udp_t* udp, uint8_t* ip, uint16_t port, uint8_t flags, uint16_t sequence, uint8_t result);
+
+static void receive(socket_t* socket, uint8_t* data, uint16_t length);
+static void send_done(ir_job_t* job, ir_job_result_t result);
+
+
+ir_udp_t* ICACHE_FLASH_ATTR ir_udp_create(ir_udp_t* udp, ir_scheduler_t* scheduler, ir_limiter_t* limiter, uint16_t port) {
+	if (udp == NULL) udp = (ir_udp_t*) m_malloc(sizeof(ir_udp_t));
+
+	socket_create_udp_listen(&udp->socket, port);
+	udp->socket.reverse = udp;
+	udp->socket.receive_cb = receive;
+
+	udp->scheduler = scheduler;
+	udp->limiter = limiter;
+	stream_create(&udp->in);
+	udp->in.swap_endian = IR_SWAP_ENDIAN;
+
+	udp->running = false;
+	udp->online = false;
+	m_memset(udp->peers, 0, sizeof(udp->peers));
+	m_memset(&udp->stats, 0, sizeof(udp->stats));
+
+	return udp;
+}
+
+void ICACHE_FLASH_ATTR ir_udp_destroy(ir_udp_t* udp, bool all) {
+	ir_udp_stop(udp);
+	socket_destroy(&udp->socket, false);
+
+	if (all) m_free(udp);
+}
+
+void ICACHE_FLASH_ATTR ir_udp_start(ir_udp_t* udp) {
+	udp->running = true;
+}
+
+void ICACHE_FLASH_ATTR ir_udp_stop(ir_udp_t* udp) {
+	udp->running = false;
+}
+
+void ICACHE_FLASH_ATTR ir_udp_network(ir_udp_t* udp, bool online) {
+	udp->online = online;
+}
+
+static ir_udp_peer_t* ICACHE_FLASH_ATTR peer_get(ir_udp_t* udp, uint8_t* ip, bool create) {
+	ir_udp_peer_t* oldest = &udp->peers[0];
+	uint8_t i = 0;
+	while (i < IR_UDP_PEERS) {
+		ir_udp_peer_t* peer = &udp->peers[i++];
+		if (peer->used && array_equals(peer->ip, ip, 4)) return peer;
+		if (!peer->used) oldest = peer;
+		else if (oldest->used && ((int32_t) (peer->last - oldest->last) < 0)) oldest = peer;
+	}
+	if (!create) return NULL;
+
+	// least recently used peer makes room
+	m_memcpy(oldest->ip, ip, 4);
+	oldest->used = true;
+	oldest->done = false;
+	return oldest;
+}
+
+static void ICACHE_FLASH_ATTR send_ack(ir_udp_t* udp, uint8_t* ip, uint16_t port, uint8_t flags, uint16_t sequence, uint8_t result) {
+	uint8_t ack[IR_UDP_ACK_LENGTH];
+	ack[0] = IR_SEND_RESPONSE;
+	ack[1] = flags;
+	ack[2] = sequence >> 8;
+	ack[3] = sequence & 0xFF;
+	ack[4] = result;
+	socket_send_to(&udp->socket, ip, port, ack, sizeof(ack));
+}
+
+static void ICACHE_FLASH_ATTR receive(socket_t* socket, uint8_t* data, uint16_t length) {
+	ir_udp_t* udp = (ir_udp_t*) socket->reverse;
+	if (!udp->running) return;
+	udp->stats.received++;
+
+	uint8_t type;
+	uint8_t flags;
+	uint16_t sequence;
+	uint32_t frequency;
+	uint16_t count;
+
+	// a datagram always carries the complete request
+	bool done = length >= IR_UDP_HEAD_LENGTH;
+	stream_t* s = &udp->in;
+	stream_data(s, data, length);
+	done = done && stream_read_primitive(s, &type, 1);
+	done = done && stream_read_primitive(s, &flags, 1);
+	done = done && stream_read_primitive(s, &sequence, 2);
+	done = done && stream_read_primitive(s, &frequency, 4);
+	done = done && stream_read_primitive(s, &count, 2);
+	if (!done || (type != IR_SEND_REQUEST) || (count > IR_TIMES_MAX)
+			|| (length != IR_UDP_HEAD_LENGTH + IR_TIME_LENGTH * count)) {
+		DEBUG_FUNCTION("malformed datagram");
+		stream_reset(s);
+		udp->stats.malformed++;
+		return;
+	}
+
+	uint8_t ip[4];
+	uint16_t port;
+	if (!socket_remote(socket, ip, &port)) {
+		DEBUG_FUNCTION("unknown remote");
+		return;
+	}
+
+	// clients on the soft ap may still reach us, but nothing is sent while the station is down
+	if (!udp->online) {
+		DEBUG_FUNCTION("offline");
+		udp->stats.offline++;
+		if (flags & IR_UDP_FLAG_ACK) send_ack(udp, ip, port, flags, sequence, IR_JOB_REJECTED);
+		return;
+	}
+
+	// the cheapest way to send pays from the same bucket as a send over tcp
+	if (ir_limiter_take(udp->limiter, ip, IR_LIMIT_SEND) > 0) {
+		DEBUG_FUNCTION("limited");
+		udp->stats.limited++;
+		if (flags & IR_UDP_FLAG_ACK) send_ack(udp, ip, port, flags, sequence, IR_JOB_REJECTED);
+		return;
+	}
+
+	if (flags & IR_UDP_FLAG_SEQUENCE) {
+		ir_udp_peer_t* peer = peer_get(udp, ip, false);
+		if ((peer != NULL) && (peer->sequence == sequence)) {
+			udp->stats.duplicates++;
+			if (peer->done && (flags & IR_UDP_FLAG_ACK)) send_ack(udp, ip, port, flags, sequence, peer->result);
+			return;
+		}
+		peer = peer_get(udp, ip, true);
+		peer->sequence = sequence;
+		peer->done = false;
+		peer->last = system_get_time();
+	}
+
+	uint16_t times_length = IR_TIME_LENGTH * count;
+	ir_udp_job_t* context = (ir_udp_job_t*) m_malloc(sizeof(ir_udp_job_t) + times_length);
+	if (context == NULL) {
+		DEBUG_FUNCTION("out of memory");
+		if (flags & IR_UDP_FLAG_ACK) send_ack(udp, ip, port, flags, sequence, IR_JOB_REJECTED);
+		return;
+	}
+	context->udp = udp;
+	m_memcpy(context->ip, ip, 4);
+	context->port = port;
+	context->flags = flags;
+	context->sequence = sequence;
+
+	ir_job_t job;
+	m_memset(&job, 0, sizeof(job));
+	job.priority = IR_PRIORITY_INTERACTIVE;
+	job.client = IR_UDP_CLIENT;
+	job.deadline = system_get_time() + IR_SEND_DEADLINE * 1000;
+	job.frequency = frequency;
+	stack_buffer_create(&job.times, (uint8_t*) (context + 1), times_length);
+	stream_read_array(s, job.times.start, IR_TIME_LENGTH, count);
+	stack_buffer_skip(&job.times, times_length);
+	job.reverse = context;
+	job.done_cb = send_done;
+
+	if (!ir_scheduler_submit(udp->scheduler, &job)) {
+		send_done(&job, IR_JOB_REJECTED);
+	}
+}
+
+static void ICACHE_FLASH_ATTR send_done(ir_job_t* job, ir_job_result_t result) {
+	ir_udp_job_t* context = (ir_udp_job_t*) job->reverse;
+	ir_udp_t* udp = context->udp;
+
+	if (context->flags & IR_UDP_FLAG_SEQUENCE) {
+		ir_udp_peer_t* peer = peer_get(udp, context->ip, false);
+		if ((peer != NULL) && (peer->sequence == context->sequence)) {
+			peer->done = true;
+			peer->result = result;
+		}
+	}
+	if (context->flags & IR_UDP_FLAG_ACK) {
+		send_ack(udp, context->ip, context->port, context->flags, context->sequence, result);
+	}
+
+	m_free(context);
+}
@@ -0,0 +1,73 @@
+
+#ifndef UDP_H_
+#define UDP_H_
+
+
+#include "c_types.h"
+
+#include "util.h"
+#include "scheduler.h"
+#include "limiter.h"
+#include "network/socket.h"
+
+
+#define IR_UDP_CLIENT 0xFFFF
+#define IR_UDP_PEERS 4
+
+#define IR_UDP_HEAD_LENGTH 10
+#define IR_UDP_ACK_LENGTH 5
+
+#define IR_UDP_FLAG_ACK 0x01
+#define IR_UDP_FLAG_SEQUENCE 0x02
+
+
+typedef struct ir_udp ir_udp_t;
+typedef struct ir_udp_peer ir_udp_peer_t;
+typedef struct ir_udp_job ir_udp_job_t;
+
+
+struct ir_udp_peer {
+	uint8_t ip[4];
+	uint16_t sequence;
+	uint8_t result;
+	bool done;
+	uint32_t last;
+	bool used;
+};
+
+struct ir_udp_job {
+	ir_udp_t* udp;
+	uint8_t ip[4];
+	uint16_t port;
+	uint8_t flags;
+	uint16_t sequence;
+};
+
+struct ir_udp {
+	socket_t socket;
+	ir_scheduler_t* scheduler;
+	ir_limiter_t* limiter;
+	stream_t in;
+
+	bool running;
+	bool online;
+	ir_udp_peer_t peers[IR_UDP_PEERS];
+
+	struct {
+		uint32_t received;
+		uint32_t duplicates;
+		uint32_t malformed;
+		uint32_t limited;
+		uint32_t offline;
+	} stats;
+};
+
+
+ir_udp_t* ir_udp_create(ir_udp_t* udp, ir_scheduler_t* scheduler, ir_limiter_t* limiter, uint16_t port);
+void ir_udp_destroy(ir_udp_t* udp, bool all);
+void ir_udp_start(ir_udp_t* udp);
+void ir_udp_stop(ir_udp_t* udp);
+void ir_udp_network(ir_udp_t* udp, bool online);
+
+
+#endif /* UDP_H_ */
@@ -1,5 +1,6 @@
 
 #include "osapi.h"
+#include "os_type.h"
 #include "user_interface.h"
 #include "gpio.h"
 #include "c_types.h"
@@ -16,20 +17,28 @@
 
 #define UPDATE_PORT 4444
 
-#define NETWORK_INTERVAL 2000
 #define NETWORK_TIMEOUT 5000
 
 #define GENERATE_NAME_PREFIX STRING("IR-")
 
 #define CONFIG_ADDRESS 0x40000
+// changes within the delay share one erase, a busy server pushes the save back up to the limit
+#define CONFIG_SAVE_DELAY 2000
+#define CONFIG_SAVE_RETRY 500
+#define CONFIG_SAVE_WAIT_MAX 30000
 
 
 static config_t config;
+static os_timer_t config_timer;
+static bool config_pending;
+static uint32_t config_changed_at;
 
 
 static bool generate_name(stack_buffer_t* buffer);
 
 static void config_changed(ir_server_t* server, string_t* ssid, string_t* password);
+static void network_changed(network_t* network, network_state_t state);
+static void config_flush(void* arg);
 
 
 static bool ICACHE_FLASH_ATTR generate_name(stack_buffer_t* buffer) {
@@ -56,7 +65,32 @@ static void config_changed(ir_server_t* server, string_t* ssid, string_t* passwo
 		network_station_connect(config.network);
 	}
 
-	config_save(&config);
+	// the values are live already, flash is written later from a timer
+	if (config_pending) return;
+	config_pending = true;
+	config_changed_at = system_get_time();
+	os_timer_disarm(&config_timer);
+	os_timer_arm(&config_timer, CONFIG_SAVE_DELAY, false);
+}
+
+static void network_changed(network_t* network, network_state_t state) {
+	ir_server_network((ir_server_t*) network->reverse, state == NETWORK_CONNECTED);
+}
+
+static void ICACHE_FLASH_ATTR config_flush(void* arg) {
+	bool late = (system_get_time() - config_changed_at) >= CONFIG_SAVE_WAIT_MAX * 1000;
+	if (!late && !ir_server_idle(config.server)) {
+		os_timer_arm(&config_timer, CONFIG_SAVE_RETRY, false);
+		return;
+	}
+
+	DEBUG_FUNCTION_START();
+	config_pending = false;
+	if (!config_save(&config)) {
+		config_pending = true;
+		config_changed_at = system_get_time();
+		os_timer_arm(&config_timer, CONFIG_SAVE_DELAY, false);
+	}
 }
 
 void user_init(void) {
@@ -77,6 +111,8 @@ void user_init(void) {
 	config.address = CONFIG_ADDRESS;
 	config.server = server;
 	config.network = network;
+	os_timer_disarm(&config_timer);
+	os_timer_setfn(&config_timer, config_flush, NULL);
 
 	DEBUG("read config");
 	if (!config_load(&config)) {
@@ -98,7 +134,9 @@ void user_init(void) {
 
 	DEBUG("init wifi");
 	string_t softap_ssid = {server->name.start, stack_buffer_size(&server->name)};
-	network_configure(network, true, true, NETWORK_INTERVAL, true, NETWORK_TIMEOUT);
+	network->reverse = server;
+	network->state_cb = network_changed;
+	network_configure(network, true, true, NETWORK_TIMEOUT);
 	network_configure_station(network, NULL, NULL, NULL);
 	network_configure_softap(network, &softap_ssid, NULL, 0, AUTH_OPEN, false, 4, 0);
 	network_mode_set(network, STATION_MODE);
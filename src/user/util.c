@@ -135,6 +135,44 @@ bool array_equals(const uint8_t* a, const uint8_t* b, uint16_t len) {
 	return true;
 }
 
+void array_swap_endian(uint8_t* array, uint8_t element_length, uint16_t count) {
+	if (element_length == 2) {
+		// align to word boundary, then swap two elements per word
+		while ((((uint32_t) array) & 3) && (count > 0)) {
+			uint8_t tmp = array[0];
+			array[0] = array[1];
+			array[1] = tmp;
+			array += 2;
+			count--;
+		}
+		uint32_t* word = (uint32_t*) array;
+		while (count >= 2) {
+			uint32_t w = *word;
+			*word++ = ((w & 0x00FF00FF) << 8) | ((w >> 8) & 0x00FF00FF);
+			count -= 2;
+		}
+		if (count > 0) {
+			array = (uint8_t*) word;
+			uint8_t tmp = array[0];
+			array[0] = array[1];
+			array[1] = tmp;
+		}
+		return;
+	}
+
+	while (count > 0) {
+		uint8_t i = 0;
+		uint8_t j = element_length - 1;
+		while (i < j) {
+			uint8_t tmp = array[i];
+			array[i++] = array[j];
+			array[j--] = tmp;
+		}
+		array += element_length;
+		count--;
+	}
+}
+
 uint8_t* array_find_char(const uint8_t* buffer, uint16_t len, char c) {
 	const uint8_t* result = buffer;
 	while (result < buffer + len) {
@@ -146,7 +184,7 @@ uint8_t* array_find_char(const uint8_t* buffer, uint16_t len, char c) {
 
 uint8_t* array_find_array(const uint8_t* outer, uint16_t outer_len, const uint8_t* inner, uint16_t inner_len) {
 	const uint8_t* result = outer;
-	while (result + inner_len < outer + outer_len) {
+	while (result + inner_len <= outer + outer_len) {
 		if (array_equals(result, inner, inner_len)) return (uint8_t*) result;
 		result++;
 	}
@@ -381,6 +419,7 @@ void int_table_clear(int_table_t* table) {
 			m_free(node);
 			node = tmp;
 		}
+		((linked_int_entry_t**) table->buckets)[i] = NULL;
 		i++;
 	}
 
@@ -491,6 +530,7 @@ void hash_table_clear(hash_table_t* table) {
 			m_free(node);
 			node = tmp;
 		}
+		((linked_hash_entry_t**) table->buckets)[i] = NULL;
 		i++;
 	}
 
@@ -686,3 +726,18 @@ bool stream_write(stream_t* stream, uint8_t* buffer, uint16_t length) {
 	m_memcpy(stream->buffer.position, buffer + stream->position, limit);
 	return stream_end(stream, limit, limit);
 }
+
+bool stream_read_array(stream_t* stream, void* array, uint8_t element_length, uint16_t count) {
+	uint8_t* a = (uint8_t*) array;
+	uint16_t limit = stream_begin(stream, element_length * count);
+
+	// copy the whole run at once; elements split across segments are swapped once complete
+	m_memcpy(a + stream->position, stream->buffer.position, limit);
+	if (stream->swap_endian) {
+		uint16_t from = stream->position / element_length;
+		uint16_t to = (stream->position + limit) / element_length;
+		array_swap_endian(a + from * element_length, element_length, to - from);
+	}
+
+	return stream_end(stream, limit, limit);
+}
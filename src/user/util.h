@@ -179,6 +179,7 @@ static inline void stack_buffer_reset(stack_buffer_t* stack) {
 }
 
 bool array_equals(const uint8_t* a, const uint8_t* b, uint16_t len);
+void array_swap_endian(uint8_t* array, uint8_t element_length, uint16_t count);
 uint8_t* array_find_char(const uint8_t* buffer, uint16_t len, char c);
 uint8_t* array_find_array(const uint8_t* outer, uint16_t outer_len, const uint8_t* inner, uint16_t inner_len);
 
@@ -245,6 +246,7 @@ bool stream_read_primitive(stream_t* stream, void* primitive, uint8_t length);
 bool stream_write_primitive(stream_t* stream, void* primitive, uint8_t length);
 bool stream_read(stream_t* stream, uint8_t* buffer, uint16_t length);
 bool stream_write(stream_t* stream, uint8_t* buffer, uint16_t length);
+bool stream_read_array(stream_t* stream, void* array, uint8_t element_length, uint16_t count);
 
 
 #endif /* UTIL_H_ */
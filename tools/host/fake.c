@@ -0,0 +1,349 @@
+
+#include "fake.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "osapi.h"
+#include "mem.h"
+#include "espconn.h"
+
+
+uint32_t fake_time;
+bool fake_verbose;
+
+sint8 fake_sent_result;
+uint32_t fake_sent_calls;
+uint8_t fake_wire[FAKE_WIRE_LENGTH];
+uint32_t fake_wire_length;
+uint32_t fake_disconnects;
+
+uint8_t fake_opmode;
+uint32_t fake_opmode_sets;
+uint32_t fake_opmode_sets_in_event;
+uint32_t fake_station_connects;
+uint32_t fake_dhcpc_restarts;
+bool fake_reconnect_policy;
+
+uint8_t fake_flash[FAKE_FLASH_LENGTH];
+int32_t fake_flash_budget;
+uint32_t fake_flash_writes;
+
+static wifi_event_handler_cb_t event_handler;
+static bool in_event;
+static os_timer_t* timers;
+static uint32_t checks;
+static uint32_t failures;
+
+
+void fake_reset(void) {
+	fake_time = 0;
+	timers = NULL;
+
+	fake_sent_result = ESPCONN_OK;
+	fake_sent_calls = 0;
+	fake_wire_length = 0;
+	fake_disconnects = 0;
+
+	fake_opmode = STATION_MODE;
+	fake_opmode_sets = 0;
+	fake_opmode_sets_in_event = 0;
+	fake_station_connects = 0;
+	fake_dhcpc_restarts = 0;
+	fake_reconnect_policy = true;
+	event_handler = NULL;
+
+	memset(fake_flash, 0xFF, sizeof(fake_flash));
+	fake_flash_budget = -1;
+	fake_flash_writes = 0;
+}
+
+static void unlink_timer(os_timer_t* timer) {
+	os_timer_t** link = &timers;
+	while (*link != NULL) {
+		if (*link == timer) {
+			*link = timer->timer_next;
+			break;
+		}
+		link = &(*link)->timer_next;
+	}
+	timer->timer_next = NULL;
+}
+
+bool fake_armed(os_timer_t* timer) {
+	os_timer_t* t = timers;
+	while (t != NULL) {
+		if (t == timer) return true;
+		t = t->timer_next;
+	}
+	return false;
+}
+
+void fake_advance(uint32_t milliseconds) {
+	uint32_t target = fake_time + milliseconds * 1000;
+	while (true) {
+		os_timer_t* next = NULL;
+		os_timer_t* t = timers;
+		while (t != NULL) {
+			if ((int32_t) (t->timer_expire - target) <= 0) {
+				if ((next == NULL) || ((int32_t) (t->timer_expire - next->timer_expire) < 0)) next = t;
+			}
+			t = t->timer_next;
+		}
+		if (next == NULL) break;
+
+		if ((int32_t) (next->timer_expire - fake_time) > 0) fake_time = next->timer_expire;
+		unlink_timer(next);
+		if (next->timer_period > 0) os_timer_arm(next, next->timer_period, true);
+		next->timer_func(next->timer_arg);
+		// time spent in a callback counts, the clock never goes back
+		if ((int32_t) (fake_time - target) > 0) target = fake_time;
+	}
+	fake_time = target;
+}
+
+void os_timer_setfn(os_timer_t* timer, os_timer_func_t* function, void* arg) {
+	timer->timer_func = function;
+	timer->timer_arg = arg;
+}
+
+void os_timer_arm(os_timer_t* timer, uint32_t milliseconds, bool repeat) {
+	if (fake_armed(timer)) unlink_timer(timer);
+	timer->timer_expire = fake_time + milliseconds * 1000;
+	timer->timer_period = repeat ? milliseconds : 0;
+	timer->timer_next = timers;
+	timers = timer;
+}
+
+void os_timer_disarm(os_timer_t* timer) {
+	if (fake_armed(timer)) unlink_timer(timer);
+}
+
+void os_delay_us(uint32_t us) {
+	fake_time += us;
+}
+
+uint32_t system_get_time(void) {
+	return fake_time;
+}
+
+void* os_malloc(size_t size) {
+	return malloc(size);
+}
+
+void* os_zalloc(size_t size) {
+	return calloc(1, size);
+}
+
+void os_free(void* p) {
+	free(p);
+}
+
+int os_printf(const char* format, ...) {
+	if (!fake_verbose) return 0;
+
+	va_list args;
+	va_start(args, format);
+	int result = vprintf(format, args);
+	va_end(args);
+	return result;
+}
+
+int os_sprintf(char* buffer, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int result = vsprintf(buffer, format, args);
+	va_end(args);
+	return result;
+}
+
+void fake_ack(struct espconn* conn) {
+	if (conn->sent_callback != NULL) conn->sent_callback(conn);
+}
+
+sint8 espconn_create(struct espconn* espconn) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_delete(struct espconn* espconn) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_accept(struct espconn* espconn) {
+	espconn->state = ESPCONN_LISTEN;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_disconnect(struct espconn* espconn) {
+	// the disconnect callback is left to the test, the sdk calls it later as well
+	fake_disconnects++;
+	espconn->state = ESPCONN_CLOSE;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_sent(struct espconn* espconn, uint8* buffer, uint16 length) {
+	fake_sent_calls++;
+	if (fake_sent_result != ESPCONN_OK) return fake_sent_result;
+	if (fake_wire_length + length > FAKE_WIRE_LENGTH) return ESPCONN_MEM;
+
+	memcpy(fake_wire + fake_wire_length, buffer, length);
+	fake_wire_length += length;
+	return ESPCONN_OK;
+}
+
+uint32 espconn_port(void) {
+	return 50000;
+}
+
+sint8 espconn_recv_hold(struct espconn* espconn) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_recv_unhold(struct espconn* espconn) {
+	return ESPCONN_OK;
+}
+
+sint8 espconn_get_connection_info(struct espconn* espconn, remot_info** info, uint8 flags) {
+	return ESPCONN_ARG;
+}
+
+sint8 espconn_regist_connectcb(struct espconn* espconn, espconn_connect_callback callback) {
+	espconn->proto.tcp->connect_callback = callback;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_reconcb(struct espconn* espconn, espconn_reconnect_callback callback) {
+	espconn->proto.tcp->reconnect_callback = callback;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_disconcb(struct espconn* espconn, espconn_connect_callback callback) {
+	espconn->proto.tcp->disconnect_callback = callback;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_recvcb(struct espconn* espconn, espconn_recv_callback callback) {
+	espconn->recv_callback = callback;
+	return ESPCONN_OK;
+}
+
+sint8 espconn_regist_sentcb(struct espconn* espconn, espconn_sent_callback callback) {
+	espconn->sent_callback = callback;
+	return ESPCONN_OK;
+}
+
+void fake_wifi_event(uint32_t event, uint8_t reason) {
+	System_Event_t info;
+	memset(&info, 0, sizeof(info));
+	info.event = event;
+	if (event == EVENT_STAMODE_DISCONNECTED) info.event_info.disconnected.reason = reason;
+
+	if (event_handler == NULL) return;
+	in_event = true;
+	event_handler(&info);
+	in_event = false;
+}
+
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb) {
+	event_handler = cb;
+}
+
+bool wifi_station_set_reconnect_policy(bool set) {
+	fake_reconnect_policy = set;
+	return true;
+}
+
+bool wifi_station_set_auto_connect(uint8 set) {
+	return true;
+}
+
+bool wifi_station_set_config(struct station_config* config) {
+	return true;
+}
+
+bool wifi_softap_set_config(struct softap_config* config) {
+	return true;
+}
+
+bool wifi_station_connect(void) {
+	fake_station_connects++;
+	return true;
+}
+
+bool wifi_station_disconnect(void) {
+	return true;
+}
+
+bool wifi_station_dhcpc_start(void) {
+	fake_dhcpc_restarts++;
+	return true;
+}
+
+bool wifi_station_dhcpc_stop(void) {
+	return true;
+}
+
+bool wifi_set_opmode(uint8 opmode) {
+	fake_opmode_sets++;
+	if (in_event) fake_opmode_sets_in_event++;
+	fake_opmode = opmode;
+	return true;
+}
+
+uint8 wifi_get_opmode(void) {
+	return fake_opmode;
+}
+
+static bool flash_power(void) {
+	// once the power is gone nothing reaches the flash any more
+	if (fake_flash_budget == 0) return false;
+	if (fake_flash_budget > 0) fake_flash_budget--;
+	fake_flash_writes++;
+	return true;
+}
+
+static bool flash_aligned(uint32 address, uint32 length) {
+	return ((address % 4) == 0) && ((length % 4) == 0) && (address + length <= FAKE_FLASH_LENGTH);
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sector) {
+	uint32 address = sector * SPI_FLASH_SEC_SIZE;
+	if (address + SPI_FLASH_SEC_SIZE > FAKE_FLASH_LENGTH) return SPI_FLASH_RESULT_ERR;
+	if (!flash_power()) return SPI_FLASH_RESULT_ERR;
+
+	memset(fake_flash + address, 0xFF, SPI_FLASH_SEC_SIZE);
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_write(uint32 address, uint32* buffer, uint32 length) {
+	if (!flash_aligned(address, length)) return SPI_FLASH_RESULT_ERR;
+	if (!flash_power()) return SPI_FLASH_RESULT_ERR;
+
+	uint8_t* b = (uint8_t*) buffer;
+	uint32 i = 0;
+	while (i < length) {
+		fake_flash[address + i] &= b[i];
+		i++;
+	}
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32 address, uint32* buffer, uint32 length) {
+	if (!flash_aligned(address, length)) return SPI_FLASH_RESULT_ERR;
+
+	memcpy(buffer, fake_flash + address, length);
+	return SPI_FLASH_RESULT_OK;
+}
+
+void fake_check(bool condition, const char* text, const char* file, int line) {
+	checks++;
+	if (condition) return;
+	failures++;
+	printf("%s:%d: check failed: %s\n", file, line, text);
+}
+
+int fake_done(const char* name) {
+	printf("%s: %u checks, %u failed\n", name, checks, failures);
+	return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef HOST_FAKE_H_
+#define HOST_FAKE_H_
+
+// fake sdk runtime: a manual clock, timers fired from that clock and plain heap memory
+
+#include "c_types.h"
+#include "os_type.h"
+#include "espconn.h"
+#include "user_interface.h"
+#include "spi_flash.h"
+
+
+#define FAKE_WIRE_LENGTH 16384
+#define FAKE_FLASH_LENGTH 0x40000
+
+
+extern uint32_t fake_time;
+extern bool fake_verbose;
+
+void fake_reset(void);
+// moves the clock forward and fires every timer that comes due, in order
+void fake_advance(uint32_t milliseconds);
+bool fake_armed(os_timer_t* timer);
+
+// espconn_sent returns fake_sent_result, accepted bytes are appended to fake_wire
+extern sint8 fake_sent_result;
+extern uint32_t fake_sent_calls;
+extern uint8_t fake_wire[FAKE_WIRE_LENGTH];
+extern uint32_t fake_wire_length;
+extern uint32_t fake_disconnects;
+// the stack acknowledges what was handed to it with the last espconn_sent
+void fake_ack(struct espconn* conn);
+
+// the wifi calls only record what they were asked for
+extern uint8_t fake_opmode;
+extern uint32_t fake_opmode_sets;
+// mode changes made while an sdk event was being handled
+extern uint32_t fake_opmode_sets_in_event;
+extern uint32_t fake_station_connects;
+extern uint32_t fake_dhcpc_restarts;
+extern bool fake_reconnect_policy;
+// replays an sdk event through the registered handler
+void fake_wifi_event(uint32_t event, uint8_t reason);
+
+// spi flash kept in ram, writes only clear bits like on nor flash
+extern uint8_t fake_flash[FAKE_FLASH_LENGTH];
+// writes and erases left before the power goes, negative for no limit
+extern int32_t fake_flash_budget;
+extern uint32_t fake_flash_writes;
+
+#define CHECK(condition) fake_check((condition), #condition, __FILE__, __LINE__)
+void fake_check(bool condition, const char* text, const char* file, int line);
+int fake_done(const char* name);
+
+
+#endif /* HOST_FAKE_H_ */
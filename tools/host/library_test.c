@@ -0,0 +1,331 @@
+
+// flash library against a ram flash: puts, replaces, deletes, compaction and a reboot after every interrupted step
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fake.h"
+
+#include "library.h"
+
+
+#define TEST_ADDRESS 0x3E000
+#define TEST_FREQUENCY 38000
+#define TEST_TIMES_MAX 512
+
+#define TEST_IDS 4
+
+
+static ir_library_t library;
+static uint8_t snapshot[FAKE_FLASH_LENGTH];
+
+
+static uint16_t* times(uint16_t value, uint16_t count) {
+	static uint16_t t[TEST_TIMES_MAX];
+	uint16_t i = 0;
+	while (i < count) {
+		t[i] = value + i;
+		i++;
+	}
+	return t;
+}
+
+static bool put(uint16_t id, const char* name, uint16_t value, uint16_t count) {
+	return ir_library_put(&library, id, IR_LIBRARY_SIGNAL, (uint8_t*) name, strlen(name), TEST_FREQUENCY,
+			times(value, count), count * 2);
+}
+
+static bool holds(uint16_t id, uint16_t value, uint16_t count) {
+	ir_library_entry_t* entry = ir_library_get(&library, id);
+	if ((entry == NULL) || (entry->length != count * 2)) return false;
+	if (entry->frequency != TEST_FREQUENCY) return false;
+
+	uint16_t t[TEST_TIMES_MAX];
+	if (!ir_library_read(&library, entry, t)) return false;
+	return memcmp(t, times(value, count), count * 2) == 0;
+}
+
+static bool named(const char* name, uint16_t id) {
+	ir_library_entry_t* entry = ir_library_find(&library, (uint8_t*) name, strlen(name));
+	return (entry != NULL) && (entry->id == id);
+}
+
+// everything in the sector is either the head, a live record or garbage
+static bool accounted(void) {
+	uint32_t used = sizeof(ir_library_head_t) + library.garbage;
+	uint8_t i = 0;
+	while (i < IR_LIBRARY_ENTRIES) {
+		ir_library_entry_t* entry = &library.entries[i++];
+		if (entry->id == IR_LIBRARY_ID_NONE) continue;
+		used += sizeof(ir_library_record_t) + ir_library_padded(entry->name_length) + ir_library_padded(entry->length);
+	}
+	return used == library.position;
+}
+
+static void reboot(void) {
+	fake_flash_budget = -1;
+	ir_library_destroy(&library, false);
+	ir_library_create(&library, TEST_ADDRESS);
+	CHECK(ir_library_load(&library));
+	CHECK(accounted());
+}
+
+static void test_basic(void) {
+	fake_reset();
+	reboot();
+	CHECK(library.count == 0);
+	CHECK(library.sector == 0);
+
+	CHECK(put(1, "tv", 1000, 68));
+	CHECK(put(2, "ac", 2000, 300));
+	CHECK(put(3, "", 3000, 1));
+	CHECK(library.count == 3);
+	CHECK(holds(1, 1000, 68));
+	CHECK(holds(2, 2000, 300));
+	CHECK(holds(3, 3000, 1));
+	CHECK(named("tv", 1));
+	CHECK(named("ac", 2));
+	CHECK(library.garbage == 0);
+
+	// names belong to one id, the none id is never stored
+	CHECK(!put(4, "tv", 4000, 10));
+	CHECK(!put(IR_LIBRARY_ID_NONE, "x", 4000, 10));
+	CHECK(library.count == 3);
+
+	CHECK(put(1, "tv on", 1100, 70));
+	CHECK(holds(1, 1100, 70));
+	CHECK(named("tv on", 1));
+	CHECK(ir_library_find(&library, (uint8_t*) "tv", 2) == NULL);
+	CHECK(library.count == 3);
+	CHECK(library.garbage > 0);
+	CHECK(accounted());
+
+	CHECK(ir_library_delete(&library, 2));
+	CHECK(!ir_library_delete(&library, 2));
+	CHECK(ir_library_get(&library, 2) == NULL);
+	CHECK(ir_library_find(&library, (uint8_t*) "ac", 2) == NULL);
+	CHECK(library.count == 2);
+	CHECK(accounted());
+
+	// the name of a deleted entry is free again
+	CHECK(put(4, "ac", 4000, 10));
+
+	uint16_t position = library.position;
+	uint16_t garbage = library.garbage;
+	reboot();
+	CHECK(library.count == 3);
+	CHECK(library.position == position);
+	CHECK(library.garbage == garbage);
+	CHECK(holds(1, 1100, 70));
+	CHECK(holds(3, 3000, 1));
+	CHECK(holds(4, 4000, 10));
+	CHECK(ir_library_get(&library, 2) == NULL);
+	CHECK(named("tv on", 1));
+	CHECK(named("ac", 4));
+}
+
+static void test_compaction(void) {
+	fake_reset();
+	reboot();
+
+	uint32_t generation = library.generation;
+	uint16_t values[TEST_IDS + 1];
+	uint16_t round = 0;
+	uint8_t compactions = 0;
+	while (compactions < 3) {
+		uint8_t sector = library.sector;
+		uint16_t id = 1 + round % TEST_IDS;
+		values[id] = round;
+		CHECK(put(id, "", round, 100));
+		if (library.sector != sector) {
+			compactions++;
+			CHECK(library.generation == generation + compactions);
+			// only the live records were carried over
+			CHECK(library.garbage <= sizeof(ir_library_record_t) + 200);
+		}
+		round++;
+	}
+	CHECK(accounted());
+
+	uint8_t sector = library.sector;
+	reboot();
+	CHECK(library.sector == sector);
+	CHECK(library.generation == generation + compactions);
+	CHECK(library.count == TEST_IDS);
+	uint16_t id = 1;
+	while (id <= TEST_IDS) {
+		CHECK(holds(id, values[id], 100));
+		id++;
+	}
+
+	// without garbage there is nothing to compact, a full library refuses and keeps what it has
+	fake_reset();
+	reboot();
+	id = 1;
+	while (put(id, "", id, TEST_TIMES_MAX)) id++;
+	CHECK(id > 2);
+	CHECK(library.count == id - 1);
+	CHECK(library.garbage == 0);
+	reboot();
+	CHECK(library.count == id - 1);
+	CHECK(holds(1, 1, TEST_TIMES_MAX));
+	CHECK(holds(id - 1, id - 1, TEST_TIMES_MAX));
+
+	// the index is full long before the flash with short records
+	fake_reset();
+	reboot();
+	id = 1;
+	while (id <= IR_LIBRARY_ENTRIES) {
+		CHECK(put(id, "", id, 1));
+		id++;
+	}
+	CHECK(!put(id, "", id, 1));
+	CHECK(put(1, "", 7, 1));
+	CHECK(holds(1, 7, 1));
+}
+
+static void test_generation(void) {
+	// the newer head wins, also when the counter wrapped
+	uint32_t generations[][2] = {{1, 2}, {2, 1}, {0xFFFFFFFF, 0}, {0, 0xFFFFFFFF}};
+	uint8_t i = 0;
+	while (i < sizeof(generations) / sizeof(generations[0])) {
+		fake_reset();
+		uint8_t s = 0;
+		while (s < IR_LIBRARY_SECTORS) {
+			ir_library_head_t head = {IR_LIBRARY_MAGIC, generations[i][s]};
+			memcpy(fake_flash + TEST_ADDRESS + s * SPI_FLASH_SEC_SIZE, &head, sizeof(head));
+			s++;
+		}
+		reboot();
+		uint8_t newer = ((int32_t) (generations[i][1] - generations[i][0]) > 0) ? 1 : 0;
+		CHECK(library.sector == newer);
+		CHECK(library.generation == generations[i][newer]);
+		i++;
+	}
+
+	// a sector without a head is never picked, whatever it holds
+	fake_reset();
+	reboot();
+	CHECK(put(1, "", 1, 10));
+	memset(fake_flash + TEST_ADDRESS + SPI_FLASH_SEC_SIZE, 0, 64);
+	reboot();
+	CHECK(library.sector == 0);
+	CHECK(holds(1, 1, 10));
+}
+
+static uint32_t steps(void (*prepare)(void), bool (*change)(void)) {
+	fake_reset();
+	reboot();
+	prepare();
+	memcpy(snapshot, fake_flash, sizeof(snapshot));
+
+	fake_flash_writes = 0;
+	CHECK(change());
+	return fake_flash_writes;
+}
+
+static void restore(uint32_t budget) {
+	memcpy(fake_flash, snapshot, sizeof(snapshot));
+	reboot();
+	fake_flash_budget = budget;
+}
+
+static void prepare_replace(void) {
+	CHECK(put(1, "tv", 1000, 68));
+	CHECK(put(2, "ac", 2000, 300));
+}
+
+static bool change_replace(void) {
+	return put(1, "tv on", 1100, 70);
+}
+
+static void test_interrupted_put(void) {
+	uint32_t total = steps(prepare_replace, change_replace);
+	CHECK(total >= 4);
+
+	uint32_t budget = 0;
+	while (budget <= total) {
+		restore(budget);
+		change_replace();
+		reboot();
+
+		// the new record counts from the moment its state is valid, the old one may still be valid then
+		CHECK(library.count == 2);
+		CHECK(holds(1, 1000, 68) || holds(1, 1100, 70));
+		CHECK(holds(1, 1100, 70) == (budget >= total - 1));
+		CHECK(named("tv", 1) == holds(1, 1000, 68));
+		CHECK(holds(2, 2000, 300));
+		CHECK(named("ac", 2));
+		CHECK((library.garbage > 0) == (budget > 0));
+
+		// whatever was left behind, the log goes on after it
+		CHECK(put(3, "dvd", 3000, 20));
+		CHECK(put(1, "tv", 1200, 68));
+		reboot();
+		CHECK(library.count == 3);
+		CHECK(holds(1, 1200, 68));
+		CHECK(holds(2, 2000, 300));
+		CHECK(holds(3, 3000, 20));
+		budget++;
+	}
+}
+
+static void prepare_compact(void) {
+	CHECK(put(1, "tv", 1000, 68));
+	CHECK(put(2, "ac", 2000, 300));
+	// replaced until the next put does not fit any more
+	uint16_t round = 0;
+	while (library.position + 2 * (sizeof(ir_library_record_t) + 2 * 200) <= SPI_FLASH_SEC_SIZE) {
+		CHECK(put(3, "", round++, 200));
+	}
+	CHECK(put(3, "", 3000, 200));
+	CHECK(library.sector == 0);
+}
+
+static bool change_compact(void) {
+	return put(4, "dvd", 4000, 200);
+}
+
+static void test_interrupted_compaction(void) {
+	uint32_t total = steps(prepare_compact, change_compact);
+	CHECK(library.sector == 1);
+	// erase, copy, head and the put itself
+	CHECK(total > 5);
+
+	uint32_t budget = 0;
+	while (budget <= total) {
+		restore(budget);
+		bool done = change_compact();
+		reboot();
+
+		CHECK(holds(1, 1000, 68));
+		CHECK(holds(2, 2000, 300));
+		CHECK(holds(3, 3000, 200));
+		CHECK(named("tv", 1));
+		CHECK(named("ac", 2));
+		CHECK(done == holds(4, 4000, 200));
+		CHECK((budget >= total) == holds(4, 4000, 200));
+
+		// the copy only takes over once its head is written, a second try picks up from there
+		CHECK(put(4, "dvd", 4001, 200));
+		reboot();
+		CHECK(library.sector == 1);
+		CHECK(library.count == 4);
+		CHECK(holds(3, 3000, 200));
+		CHECK(holds(4, 4001, 200));
+		budget++;
+	}
+}
+
+int main(int argc, char** argv) {
+	fake_verbose = (argc > 1);
+	ir_library_create(&library, TEST_ADDRESS);
+
+	test_basic();
+	test_compaction();
+	test_generation();
+	test_interrupted_put();
+	test_interrupted_compaction();
+
+	return fake_done("library_test");
+}
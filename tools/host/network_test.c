@@ -0,0 +1,229 @@
+
+// station state machine driven by replayed sdk event sequences, the wifi calls are only recorded
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fake.h"
+
+#include "network.h"
+
+
+#define TEST_FAILOVER_TIME 10000
+#define TEST_STATES_MAX 32
+
+
+static network_state_t states[TEST_STATES_MAX];
+static uint16_t states_count;
+
+
+static void changed(network_t* network, network_state_t state) {
+	if (states_count < TEST_STATES_MAX) states[states_count] = state;
+	states_count++;
+}
+
+static network_t* boot(bool failover) {
+	fake_reset();
+	states_count = 0;
+
+	network_t* network = network_get();
+	memset(network, 0, sizeof(network_t));
+	network->state_cb = changed;
+	network_configure(network, true, failover, TEST_FAILOVER_TIME);
+	network_mode_set(network, STATION_MODE);
+	fake_opmode_sets = 0;
+	return network;
+}
+
+static void test_online(void) {
+	network_t* network = boot(true);
+	CHECK(!fake_reconnect_policy);
+	CHECK(network->state == NETWORK_CONNECTING);
+
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	CHECK(network->state == NETWORK_ASSOCIATED);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+	CHECK(network->state == NETWORK_CONNECTED);
+	CHECK(!fake_armed(&network->failover_timer));
+
+	CHECK(states_count == 2);
+	CHECK(states[0] == NETWORK_ASSOCIATED);
+	CHECK(states[1] == NETWORK_CONNECTED);
+
+	// the boot deadline is gone with the address
+	fake_advance(TEST_FAILOVER_TIME * 2);
+	CHECK(network->state == NETWORK_CONNECTED);
+	CHECK(fake_opmode == STATION_MODE);
+	CHECK(fake_opmode_sets == 0);
+}
+
+static void test_backoff(void) {
+	network_t* network = boot(false);
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+
+	uint32_t delay = NETWORK_BACKOFF_MIN;
+	for (uint8_t i = 0; i < 10; i++) {
+		fake_station_connects = 0;
+		fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+		CHECK(network->state == NETWORK_CONNECTING);
+
+		fake_advance(delay - 1);
+		CHECK(fake_station_connects == 0);
+		fake_advance(1);
+		CHECK(fake_station_connects == 1);
+
+		delay = (delay * 2 > NETWORK_BACKOFF_MAX) ? NETWORK_BACKOFF_MAX : delay * 2;
+	}
+	CHECK(delay == NETWORK_BACKOFF_MAX);
+	CHECK(network->state == NETWORK_CONNECTING);
+	CHECK(fake_opmode_sets == 0);
+
+	// an address resets the pacing
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+	fake_station_connects = 0;
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	fake_advance(NETWORK_BACKOFF_MIN);
+	CHECK(fake_station_connects == 1);
+
+	// a connect from outside resets it as well and cancels the pending retry
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	network_station_connect(network);
+	CHECK(fake_station_connects == 2);
+	CHECK(!fake_armed(&network->backoff_timer));
+	CHECK(network->backoff == NETWORK_BACKOFF_MIN);
+
+	// nothing is retried once the station is back
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+	fake_advance(NETWORK_BACKOFF_MAX);
+	CHECK(fake_station_connects == 2);
+}
+
+static void test_failover(void) {
+	network_t* network = boot(true);
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+
+	// repeated losses keep the first deadline
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	fake_advance(TEST_FAILOVER_TIME / 2);
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_NO_AP_FOUND);
+	fake_advance(TEST_FAILOVER_TIME / 2 - 1);
+	CHECK(network->state == NETWORK_CONNECTING);
+	CHECK(fake_opmode == STATION_MODE);
+
+	fake_advance(1);
+	CHECK(network->state == NETWORK_FAILOVER);
+	CHECK(network->reason == REASON_NO_AP_FOUND);
+	CHECK(fake_opmode == STATIONAP_MODE);
+	CHECK(fake_opmode_sets == 1);
+
+	// the station keeps trying while the soft ap is up
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_NO_AP_FOUND);
+	CHECK(network->state == NETWORK_FAILOVER);
+	CHECK(fake_armed(&network->backoff_timer));
+	CHECK(!fake_armed(&network->failover_timer));
+
+	// the soft ap is dropped after the event returned
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	CHECK(network->state == NETWORK_FAILOVER);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+	CHECK(network->state == NETWORK_CONNECTED);
+	CHECK(fake_opmode == STATIONAP_MODE);
+	fake_advance(0);
+	CHECK(fake_opmode == STATION_MODE);
+	CHECK(fake_opmode_sets == 2);
+	CHECK(fake_opmode_sets_in_event == 0);
+
+	CHECK(states_count == 5);
+	CHECK(states[2] == NETWORK_CONNECTING);
+	CHECK(states[3] == NETWORK_FAILOVER);
+	CHECK(states[4] == NETWORK_CONNECTED);
+
+	// a loss before the restore ran keeps the soft ap
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	fake_advance(TEST_FAILOVER_TIME);
+	CHECK(network->state == NETWORK_FAILOVER);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	fake_advance(0);
+	CHECK(network->state == NETWORK_CONNECTING);
+	CHECK(fake_opmode == STATIONAP_MODE);
+	CHECK(fake_opmode_sets_in_event == 0);
+}
+
+static void test_recovered(void) {
+	network_t* network = boot(true);
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, REASON_BEACON_TIMEOUT);
+	fake_advance(TEST_FAILOVER_TIME - 1);
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+
+	fake_advance(TEST_FAILOVER_TIME * 2);
+	CHECK(network->state == NETWORK_CONNECTED);
+	CHECK(fake_opmode_sets == 0);
+}
+
+static void test_credentials(uint8_t reason) {
+	network_t* network = boot(true);
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+
+	// no waiting for the deadline, but no mode change inside the sdk callback either
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, reason);
+	CHECK(network->state == NETWORK_CONNECTING);
+	CHECK(fake_opmode == STATION_MODE);
+	CHECK(fake_opmode_sets == 0);
+
+	fake_advance(0);
+	CHECK(network->state == NETWORK_FAILOVER);
+	CHECK(network->reason == reason);
+	CHECK(fake_opmode == STATIONAP_MODE);
+	CHECK(fake_opmode_sets == 1);
+	CHECK(fake_opmode_sets_in_event == 0);
+
+	// the address arriving first wins
+	boot(true);
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, reason);
+	fake_wifi_event(EVENT_STAMODE_GOT_IP, 0);
+	fake_advance(TEST_FAILOVER_TIME);
+	CHECK(network->state == NETWORK_CONNECTED);
+	CHECK(fake_opmode_sets == 0);
+
+	// without failover the station just keeps retrying
+	boot(false);
+	fake_wifi_event(EVENT_STAMODE_DISCONNECTED, reason);
+	fake_advance(TEST_FAILOVER_TIME);
+	CHECK(network->state == NETWORK_CONNECTING);
+	CHECK(fake_opmode_sets == 0);
+	CHECK(fake_station_connects > 0);
+}
+
+static void test_dhcp(void) {
+	network_t* network = boot(true);
+	fake_wifi_event(EVENT_STAMODE_CONNECTED, 0);
+	fake_wifi_event(EVENT_STAMODE_DHCP_TIMEOUT, 0);
+	CHECK(fake_dhcpc_restarts == 1);
+	CHECK(network->state == NETWORK_ASSOCIATED);
+
+	// associated but without an address still fails over
+	fake_advance(TEST_FAILOVER_TIME);
+	CHECK(network->state == NETWORK_FAILOVER);
+	CHECK(fake_opmode_sets_in_event == 0);
+}
+
+int main(int argc, char** argv) {
+	fake_verbose = (argc > 1);
+
+	test_online();
+	test_backoff();
+	test_failover();
+	test_recovered();
+	test_credentials(REASON_AUTH_FAIL);
+	test_credentials(REASON_4WAY_HANDSHAKE_TIMEOUT);
+	test_dhcp();
+
+	return fake_done("network_test");
+}
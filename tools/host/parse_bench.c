@@ -0,0 +1,98 @@
+
+// parse throughput of send request timings: per sample primitives against one bulk copy and swap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fake.h"
+
+#include "util.h"
+
+
+#define BENCH_TIME_LENGTH 2
+#define BENCH_SAMPLES 300
+#define BENCH_ROUNDS 20000
+
+
+typedef bool (*parse_t)(stream_t* in, uint8_t* times, uint16_t count, uint16_t* read);
+
+
+static uint8_t wire[BENCH_SAMPLES * BENCH_TIME_LENGTH];
+static uint16_t expected[BENCH_SAMPLES];
+static uint16_t times[BENCH_SAMPLES];
+
+
+// what read_send_request did before: one primitive per sample, the count carried across segments
+static bool parse_primitive(stream_t* in, uint8_t* times, uint16_t count, uint16_t* read) {
+	while (*read < count) {
+		if (!stream_read_primitive(in, times + *read * BENCH_TIME_LENGTH, BENCH_TIME_LENGTH)) return false;
+		(*read)++;
+	}
+	return true;
+}
+
+static bool parse_bulk(stream_t* in, uint8_t* times, uint16_t count, uint16_t* read) {
+	return stream_read_array(in, times, BENCH_TIME_LENGTH, count);
+}
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool parse_frame(parse_t parse, uint16_t segment) {
+	stream_t in;
+	stream_create(&in);
+	in.swap_endian = true;
+
+	uint16_t read = 0;
+	uint16_t offset = 0;
+	bool done = false;
+	while (!done && (offset < sizeof(wire))) {
+		uint16_t length = MIN(segment, sizeof(wire) - offset);
+		stream_data(&in, wire + offset, length);
+		done = parse(&in, (uint8_t*) times, BENCH_SAMPLES, &read);
+		offset += length;
+	}
+	return done;
+}
+
+static void bench(const char* name, parse_t parse, uint16_t segment) {
+	memset(times, 0, sizeof(times));
+	if (!parse_frame(parse, segment) || (memcmp(times, expected, sizeof(times)) != 0)) {
+		printf("%-10s segment %4d: wrong result\n", name, segment);
+		exit(1);
+	}
+
+	double start = now();
+	uint32_t i = 0;
+	while (i++ < BENCH_ROUNDS) parse_frame(parse, segment);
+	double elapsed = now() - start;
+
+	double samples = (double) BENCH_SAMPLES * BENCH_ROUNDS;
+	printf("%-10s segment %4d: %8.1f Msamples/s %8.1f MB/s\n", name, segment,
+			samples / elapsed / 1e6, samples * BENCH_TIME_LENGTH / elapsed / 1e6);
+}
+
+int main(int argc, char** argv) {
+	srand(1);
+	uint16_t i = 0;
+	while (i < BENCH_SAMPLES) {
+		expected[i] = 200 + rand() % 9000;
+		wire[2 * i] = expected[i] >> 8;
+		wire[2 * i + 1] = expected[i] & 0xFF;
+		i++;
+	}
+
+	// a full segment, the default mss of slow links and an odd size that splits timings
+	uint16_t segments[] = {1460, 536, 97};
+	i = 0;
+	while (i < sizeof(segments) / sizeof(segments[0])) {
+		bench("primitive", parse_primitive, segments[i]);
+		bench("bulk", parse_bulk, segments[i]);
+		i++;
+	}
+	return 0;
+}
@@ -0,0 +1,290 @@
+
+// transmit scheduler driven by synthetic job streams, the transmitter only records what it was given
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fake.h"
+
+#include "scheduler.h"
+#include "signal.h"
+
+
+#define TEST_AIRTIME 1000
+#define TEST_FIRED_MAX 1024
+
+#define CLIENT_A 1
+#define CLIENT_B 2
+#define CLIENT_UDP 0xFFFF
+
+
+static signal_station_t station;
+static ir_scheduler_t scheduler;
+
+// jobs are told apart by their frequency
+static uint32_t fired[TEST_FIRED_MAX];
+static uint32_t fired_at[TEST_FIRED_MAX];
+static uint16_t fired_count;
+static uint16_t results[4];
+static uint16_t resumed;
+
+
+void signal_send(signal_station_t* s) {
+	if (fired_count < TEST_FIRED_MAX) {
+		fired_at[fired_count] = fake_time;
+		fired[fired_count++] = s->frequency;
+	}
+	fake_time += TEST_AIRTIME;
+}
+
+void signal_station_reset(signal_station_t* s) {
+	s->receiving = false;
+}
+
+void signal_receive_next(signal_station_t* s) {
+	resumed++;
+}
+
+static void done(ir_job_t* job, ir_job_result_t result) {
+	results[result]++;
+}
+
+static void setup(void) {
+	fake_reset();
+	fake_time = 1000000;
+	memset(&station, 0, sizeof(station));
+	ir_scheduler_create(&scheduler, &station, 4);
+	fired_count = 0;
+	resumed = 0;
+	memset(results, 0, sizeof(results));
+}
+
+static bool submit(uint8_t priority, uint16_t client, uint16_t tag, uint32_t id) {
+	ir_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.priority = priority;
+	job.client = client;
+	job.tag = tag;
+	job.frequency = id;
+	job.done_cb = done;
+	return ir_scheduler_submit(&scheduler, &job);
+}
+
+static bool submit_at(uint16_t client, uint32_t at, uint32_t id) {
+	ir_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.priority = IR_PRIORITY_NORMAL;
+	job.client = client;
+	job.frequency = id;
+	job.timed = true;
+	job.at = at;
+	job.done_cb = done;
+	return ir_scheduler_submit(&scheduler, &job);
+}
+
+static void test_priority_order(void) {
+	setup();
+	CHECK(submit(IR_PRIORITY_BULK, CLIENT_A, 0, 1));
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 0, 2));
+	CHECK(submit(IR_PRIORITY_INTERACTIVE, CLIENT_B, 0, 3));
+	CHECK(submit(IR_PRIORITY_INTERACTIVE, CLIENT_A, 0, 4));
+	CHECK(submit(IR_PRIORITY_BULK, CLIENT_B, 0, 5));
+	CHECK(ir_scheduler_depth(&scheduler) == 5);
+	CHECK(!ir_scheduler_idle(&scheduler));
+
+	fake_advance(0);
+	uint32_t order[] = {3, 4, 2, 1, 5};
+	CHECK(fired_count == 5);
+	CHECK(memcmp(fired, order, sizeof(order)) == 0);
+	CHECK(results[IR_JOB_SENT] == 5);
+	CHECK(scheduler.stats.depth_max == 5);
+	CHECK(scheduler.stats.wait_max == 4 * TEST_AIRTIME);
+	CHECK(ir_scheduler_idle(&scheduler));
+}
+
+static void test_deadline(void) {
+	setup();
+	ir_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.client = CLIENT_A;
+	job.frequency = 1;
+	job.done_cb = done;
+	job.deadline = fake_time + TEST_AIRTIME / 2;
+	CHECK(submit(IR_PRIORITY_INTERACTIVE, CLIENT_A, 0, 2));
+	CHECK(ir_scheduler_submit(&scheduler, &job));
+
+	// the first send takes longer than the second job may wait
+	fake_advance(0);
+	CHECK(fired_count == 1);
+	CHECK(fired[0] == 2);
+	CHECK(results[IR_JOB_EXPIRED] == 1);
+	CHECK(scheduler.stats.expired == 1);
+}
+
+static void test_full(void) {
+	setup();
+	uint8_t i = 0;
+	while (i < IR_SCHEDULER_JOBS) CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 0, i++));
+	CHECK(!submit(IR_PRIORITY_INTERACTIVE, CLIENT_B, 0, 99));
+	CHECK(scheduler.stats.rejected == 1);
+
+	fake_advance(0);
+	CHECK(fired_count == IR_SCHEDULER_JOBS);
+	CHECK(submit(IR_PRIORITY_INTERACTIVE, CLIENT_B, 0, 99));
+}
+
+static void test_cancel(void) {
+	setup();
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 5, 1));
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_B, 5, 2));
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 6, 3));
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 5, 4));
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_UDP, 0, 5));
+
+	CHECK(ir_scheduler_cancel_tag(&scheduler, CLIENT_A, 5) == 2);
+	CHECK(ir_scheduler_cancel(&scheduler, CLIENT_B) == 1);
+	CHECK(results[IR_JOB_CANCELLED] == 3);
+	CHECK(ir_scheduler_depth(&scheduler) == 2);
+
+	// the heap is still in order after removals from the middle
+	fake_advance(0);
+	uint32_t order[] = {3, 5};
+	CHECK(fired_count == 2);
+	CHECK(memcmp(fired, order, sizeof(order)) == 0);
+}
+
+static void test_cancel_none(void) {
+	setup();
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_UDP, 0, 1));
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 0, 2));
+	CHECK(submit_at(CLIENT_B, fake_time + 100000, 3));
+
+	// an idle worker has no client, it must not cancel jobs of anybody else
+	CHECK(ir_scheduler_cancel(&scheduler, IR_SCHEDULER_CLIENT_NONE) == 0);
+	CHECK(ir_scheduler_cancel_tag(&scheduler, IR_SCHEDULER_CLIENT_NONE, 0) == 0);
+	CHECK(results[IR_JOB_CANCELLED] == 0);
+
+	CHECK(ir_scheduler_cancel_all(&scheduler) == 3);
+	CHECK(results[IR_JOB_CANCELLED] == 3);
+	fake_advance(200);
+	CHECK(fired_count == 0);
+	CHECK(ir_scheduler_idle(&scheduler));
+}
+
+static void test_hold(void) {
+	setup();
+	CHECK(ir_scheduler_hold(&scheduler, CLIENT_A));
+	CHECK(!ir_scheduler_hold(&scheduler, CLIENT_B));
+	CHECK(submit(IR_PRIORITY_INTERACTIVE, CLIENT_B, 0, 1));
+	fake_advance(100);
+	CHECK(fired_count == 0);
+
+	// only the holder hands the transmitter back
+	ir_scheduler_unhold(&scheduler, CLIENT_B);
+	fake_advance(100);
+	CHECK(fired_count == 0);
+	ir_scheduler_unhold(&scheduler, CLIENT_A);
+	fake_advance(0);
+	CHECK(fired_count == 1);
+	CHECK(!ir_scheduler_held(&scheduler));
+}
+
+static void test_at(void) {
+	setup();
+	uint32_t at = fake_time + 50000;
+	CHECK(submit_at(CLIENT_A, at, 1));
+	CHECK(ir_scheduler_depth(&scheduler) == 0);
+	CHECK(!ir_scheduler_idle(&scheduler));
+
+	// the timer wakes up a margin early and the rest is waited out
+	fake_advance(47);
+	CHECK(fired_count == 0);
+	fake_advance(1);
+	CHECK(fired_count == 1);
+	CHECK(fired_at[0] == at);
+	CHECK(ir_scheduler_idle(&scheduler));
+
+	// the earliest of several timed jobs goes first, whatever the submit order
+	at = fake_time + 30000;
+	CHECK(submit_at(CLIENT_A, at + 20000, 2));
+	CHECK(submit_at(CLIENT_A, at, 3));
+	fake_advance(60);
+	CHECK(fired_count == 3);
+	CHECK((fired[1] == 3) && (fired_at[1] == at));
+	CHECK((fired[2] == 2) && (fired_at[2] == at + 20000));
+
+	// a held transmitter turns a due timed job into a queued one
+	CHECK(ir_scheduler_hold(&scheduler, CLIENT_B));
+	CHECK(submit_at(CLIENT_A, fake_time + 10000, 4));
+	fake_advance(20);
+	CHECK(fired_count == 3);
+	CHECK(ir_scheduler_depth(&scheduler) == 1);
+	ir_scheduler_unhold(&scheduler, CLIENT_B);
+	fake_advance(0);
+	CHECK(fired_count == 4);
+	CHECK(fired[3] == 4);
+}
+
+static void test_receive_resumed(void) {
+	setup();
+	station.receiving = true;
+	CHECK(submit(IR_PRIORITY_NORMAL, CLIENT_A, 0, 1));
+	fake_advance(0);
+	CHECK(fired_count == 1);
+	CHECK(resumed == 1);
+	CHECK(station.receiving);
+}
+
+static void test_stream(void) {
+	setup();
+	srand(29);
+
+	// bursts of random jobs, each burst must leave by priority and then in submit order
+	uint32_t submitted = 0;
+	uint32_t rejected = 0;
+	uint32_t cancelled = 0;
+	uint16_t round = 0;
+	while (round++ < 200) {
+		uint8_t n = rand() % (IR_SCHEDULER_JOBS + 4);
+		uint8_t i = 0;
+		while (i < n) {
+			uint8_t priority = rand() % 3;
+			uint16_t client = 1 + rand() % 3;
+			uint32_t id = (priority << 24) | (round << 8) | i;
+			if (submit(priority, client, i, id)) submitted++;
+			else rejected++;
+			i++;
+		}
+		if ((rand() % 4) == 0) cancelled += ir_scheduler_cancel(&scheduler, 1 + rand() % 3);
+
+		uint16_t from = fired_count;
+		fake_advance(0);
+		i = from + 1;
+		while (i < fired_count) {
+			CHECK(fired[i - 1] < fired[i]);
+			i++;
+		}
+		CHECK(ir_scheduler_idle(&scheduler));
+		fired_count = 0;
+	}
+
+	CHECK(scheduler.stats.submitted == submitted);
+	CHECK(scheduler.stats.rejected == rejected);
+	CHECK(scheduler.stats.cancelled == cancelled);
+	CHECK(scheduler.stats.sent + scheduler.stats.cancelled == submitted);
+	CHECK(scheduler.stats.depth_max == IR_SCHEDULER_JOBS);
+	printf("scheduler_test: stream of %u jobs, %u rejected, %u cancelled\n", submitted, rejected, cancelled);
+}
+
+int main(int argc, char** argv) {
+	test_priority_order();
+	test_deadline();
+	test_full();
+	test_cancel();
+	test_cancel_none();
+	test_hold();
+	test_at();
+	test_receive_resumed();
+	test_stream();
+	return fake_done("scheduler_test");
+}
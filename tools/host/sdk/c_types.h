@@ -0,0 +1,39 @@
+#ifndef HOST_C_TYPES_H_
+#define HOST_C_TYPES_H_
+
+// just enough of the sdk types to build the hardware independent modules on the host
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int8_t sint8;
+typedef int16_t sint16;
+typedef int32_t sint32;
+typedef int64_t sint64;
+
+typedef unsigned char bool;
+#define true 1
+#define false 0
+
+#define ICACHE_FLASH_ATTR
+
+#define BIT(n) (1UL << (n))
+#define BIT2 BIT(2)
+#define BIT3 BIT(3)
+#define BIT4 BIT(4)
+#define BIT5 BIT(5)
+
+typedef enum {
+	OK = 0,
+	FAIL,
+	PENDING,
+	BUSY,
+	CANCEL
+} STATUS;
+
+#endif /* HOST_C_TYPES_H_ */
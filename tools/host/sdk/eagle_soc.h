@@ -0,0 +1,3 @@
+#ifndef HOST_EAGLE_SOC_H_
+#define HOST_EAGLE_SOC_H_
+#endif /* HOST_EAGLE_SOC_H_ */
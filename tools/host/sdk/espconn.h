@@ -0,0 +1,82 @@
+#ifndef HOST_ESPCONN_H_
+#define HOST_ESPCONN_H_
+
+#include "c_types.h"
+
+#define ESPCONN_OK 0
+#define ESPCONN_MEM -1
+#define ESPCONN_ARG -12
+
+enum espconn_type {
+	ESPCONN_INVALID = 0,
+	ESPCONN_TCP = 0x10,
+	ESPCONN_UDP = 0x20
+};
+
+enum espconn_state {
+	ESPCONN_NONE,
+	ESPCONN_WAIT,
+	ESPCONN_LISTEN,
+	ESPCONN_CONNECT,
+	ESPCONN_WRITE,
+	ESPCONN_READ,
+	ESPCONN_CLOSE
+};
+
+typedef void (*espconn_connect_callback)(void* arg);
+typedef void (*espconn_reconnect_callback)(void* arg, sint8 error);
+typedef void (*espconn_recv_callback)(void* arg, char* data, unsigned short length);
+typedef void (*espconn_sent_callback)(void* arg);
+
+typedef struct _esp_tcp {
+	int remote_port;
+	int local_port;
+	uint8 local_ip[4];
+	uint8 remote_ip[4];
+	espconn_connect_callback connect_callback;
+	espconn_reconnect_callback reconnect_callback;
+	espconn_connect_callback disconnect_callback;
+} esp_tcp;
+
+typedef struct _esp_udp {
+	int remote_port;
+	int local_port;
+	uint8 local_ip[4];
+	uint8 remote_ip[4];
+} esp_udp;
+
+typedef struct _remot_info {
+	enum espconn_state state;
+	int remote_port;
+	uint8 remote_ip[4];
+} remot_info;
+
+struct espconn {
+	enum espconn_type type;
+	enum espconn_state state;
+	union {
+		esp_tcp* tcp;
+		esp_udp* udp;
+	} proto;
+	espconn_recv_callback recv_callback;
+	espconn_sent_callback sent_callback;
+	uint8 link_cnt;
+	void* reverse;
+};
+
+sint8 espconn_create(struct espconn* espconn);
+sint8 espconn_delete(struct espconn* espconn);
+sint8 espconn_accept(struct espconn* espconn);
+sint8 espconn_disconnect(struct espconn* espconn);
+sint8 espconn_sent(struct espconn* espconn, uint8* buffer, uint16 length);
+uint32 espconn_port(void);
+sint8 espconn_recv_hold(struct espconn* espconn);
+sint8 espconn_recv_unhold(struct espconn* espconn);
+sint8 espconn_get_connection_info(struct espconn* espconn, remot_info** info, uint8 flags);
+sint8 espconn_regist_connectcb(struct espconn* espconn, espconn_connect_callback callback);
+sint8 espconn_regist_reconcb(struct espconn* espconn, espconn_reconnect_callback callback);
+sint8 espconn_regist_disconcb(struct espconn* espconn, espconn_connect_callback callback);
+sint8 espconn_regist_recvcb(struct espconn* espconn, espconn_recv_callback callback);
+sint8 espconn_regist_sentcb(struct espconn* espconn, espconn_sent_callback callback);
+
+#endif /* HOST_ESPCONN_H_ */
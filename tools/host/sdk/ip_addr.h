@@ -0,0 +1,17 @@
+#ifndef HOST_IP_ADDR_H_
+#define HOST_IP_ADDR_H_
+
+#include "c_types.h"
+
+struct ip_addr {
+	uint32 addr;
+};
+typedef struct ip_addr ip_addr_t;
+
+struct ip_info {
+	struct ip_addr ip;
+	struct ip_addr netmask;
+	struct ip_addr gw;
+};
+
+#endif /* HOST_IP_ADDR_H_ */
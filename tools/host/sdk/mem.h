@@ -0,0 +1,10 @@
+#ifndef HOST_MEM_H_
+#define HOST_MEM_H_
+
+#include <stddef.h>
+
+void* os_malloc(size_t size);
+void* os_zalloc(size_t size);
+void os_free(void* p);
+
+#endif /* HOST_MEM_H_ */
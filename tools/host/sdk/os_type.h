@@ -0,0 +1,20 @@
+#ifndef HOST_OS_TYPE_H_
+#define HOST_OS_TYPE_H_
+
+#include "c_types.h"
+
+typedef void ETSTimerFunc(void* arg);
+
+// same layout as the sdk, the fake runtime keeps armed timers in a list
+typedef struct _ETSTIMER_ {
+	struct _ETSTIMER_* timer_next;
+	uint32_t timer_expire;
+	uint32_t timer_period;
+	ETSTimerFunc* timer_func;
+	void* timer_arg;
+} ETSTimer;
+
+typedef ETSTimerFunc os_timer_func_t;
+typedef ETSTimer os_timer_t;
+
+#endif /* HOST_OS_TYPE_H_ */
@@ -0,0 +1,25 @@
+#ifndef HOST_OSAPI_H_
+#define HOST_OSAPI_H_
+
+#include "c_types.h"
+#include "os_type.h"
+#include "mem.h"
+
+#define os_memcpy memcpy
+#define os_memmove memmove
+#define os_memset memset
+#define os_memcmp memcmp
+#define os_strlen strlen
+#define ets_memset memset
+
+int os_printf(const char* format, ...);
+int os_sprintf(char* buffer, const char* format, ...);
+
+void os_timer_setfn(os_timer_t* timer, os_timer_func_t* function, void* arg);
+void os_timer_arm(os_timer_t* timer, uint32_t milliseconds, bool repeat);
+void os_timer_disarm(os_timer_t* timer);
+void os_delay_us(uint32_t us);
+
+uint32_t system_get_time(void);
+
+#endif /* HOST_OSAPI_H_ */
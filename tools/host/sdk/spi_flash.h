@@ -0,0 +1,18 @@
+#ifndef HOST_SPI_FLASH_H_
+#define HOST_SPI_FLASH_H_
+
+#include "c_types.h"
+
+typedef enum {
+	SPI_FLASH_RESULT_OK,
+	SPI_FLASH_RESULT_ERR,
+	SPI_FLASH_RESULT_TIMEOUT
+} SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sector);
+SpiFlashOpResult spi_flash_write(uint32 address, uint32* buffer, uint32 length);
+SpiFlashOpResult spi_flash_read(uint32 address, uint32* buffer, uint32 length);
+
+#endif /* HOST_SPI_FLASH_H_ */
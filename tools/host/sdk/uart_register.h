@@ -0,0 +1,3 @@
+#ifndef HOST_UART_REGISTER_H_
+#define HOST_UART_REGISTER_H_
+#endif /* HOST_UART_REGISTER_H_ */
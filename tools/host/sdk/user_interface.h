@@ -0,0 +1,110 @@
+#ifndef HOST_USER_INTERFACE_H_
+#define HOST_USER_INTERFACE_H_
+
+#include "c_types.h"
+#include "os_type.h"
+#include "ip_addr.h"
+
+#define NULL_MODE		0x00
+#define STATION_MODE	0x01
+#define SOFTAP_MODE		0x02
+#define STATIONAP_MODE	0x03
+
+typedef enum _auth_mode {
+	AUTH_OPEN = 0,
+	AUTH_WEP,
+	AUTH_WPA_PSK,
+	AUTH_WPA2_PSK,
+	AUTH_WPA_WPA2_PSK,
+	AUTH_MAX
+} AUTH_MODE;
+
+struct station_config {
+	uint8 ssid[32];
+	uint8 password[64];
+	uint8 bssid_set;
+	uint8 bssid[6];
+};
+
+struct softap_config {
+	uint8 ssid[32];
+	uint8 password[64];
+	uint8 ssid_len;
+	uint8 channel;
+	AUTH_MODE authmode;
+	uint8 ssid_hidden;
+	uint8 max_connection;
+	uint16 beacon_interval;
+};
+
+enum {
+	EVENT_STAMODE_CONNECTED = 0,
+	EVENT_STAMODE_DISCONNECTED,
+	EVENT_STAMODE_AUTHMODE_CHANGE,
+	EVENT_STAMODE_GOT_IP,
+	EVENT_STAMODE_DHCP_TIMEOUT,
+	EVENT_SOFTAPMODE_STACONNECTED,
+	EVENT_SOFTAPMODE_STADISCONNECTED,
+	EVENT_SOFTAPMODE_PROBEREQRECVED,
+	EVENT_MAX
+};
+
+enum {
+	REASON_UNSPECIFIED = 1,
+	REASON_AUTH_EXPIRE = 2,
+	REASON_AUTH_LEAVE = 3,
+	REASON_ASSOC_EXPIRE = 4,
+	REASON_4WAY_HANDSHAKE_TIMEOUT = 15,
+	REASON_BEACON_TIMEOUT = 200,
+	REASON_NO_AP_FOUND = 201,
+	REASON_AUTH_FAIL = 202,
+	REASON_ASSOC_FAIL = 203,
+	REASON_HANDSHAKE_TIMEOUT = 204
+};
+
+typedef struct {
+	uint8 ssid[32];
+	uint8 ssid_len;
+	uint8 bssid[6];
+	uint8 channel;
+} Event_StaMode_Connected_t;
+
+typedef struct {
+	uint8 ssid[32];
+	uint8 ssid_len;
+	uint8 bssid[6];
+	uint8 reason;
+} Event_StaMode_Disconnected_t;
+
+typedef struct {
+	struct ip_addr ip;
+	struct ip_addr mask;
+	struct ip_addr gw;
+} Event_StaMode_Got_IP_t;
+
+typedef union {
+	Event_StaMode_Connected_t connected;
+	Event_StaMode_Disconnected_t disconnected;
+	Event_StaMode_Got_IP_t got_ip;
+} Event_Info_u;
+
+typedef struct _esp_event {
+	uint32 event;
+	Event_Info_u event_info;
+} System_Event_t;
+
+typedef void (*wifi_event_handler_cb_t)(System_Event_t* event);
+
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb);
+bool wifi_station_set_reconnect_policy(bool set);
+bool wifi_station_set_auto_connect(uint8 set);
+bool wifi_station_set_config(struct station_config* config);
+bool wifi_softap_set_config(struct softap_config* config);
+bool wifi_station_connect(void);
+bool wifi_station_disconnect(void);
+bool wifi_station_dhcpc_start(void);
+bool wifi_station_dhcpc_stop(void);
+bool wifi_set_opmode(uint8 opmode);
+uint8 wifi_get_opmode(void);
+
+#endif /* HOST_USER_INTERFACE_H_ */
@@ -0,0 +1,202 @@
+
+// output queue of a socket: one send in flight, partial acknowledgements, coalescing and failed sends
+
+#include <stdio.h>
+
+#include "fake.h"
+
+#include "network/socket.h"
+
+
+static struct espconn conn;
+static esp_tcp tcp;
+static uint32_t released;
+static uint32_t disconnected;
+
+
+static void release(socket_t* socket, void* reverse) {
+	released++;
+}
+
+static void lost(socket_t* socket) {
+	disconnected++;
+}
+
+static socket_t* setup(uint16_t flush_delay) {
+	fake_reset();
+	memset(&conn, 0, sizeof(conn));
+	memset(&tcp, 0, sizeof(tcp));
+	conn.type = ESPCONN_TCP;
+	conn.state = ESPCONN_CONNECT;
+	conn.proto.tcp = &tcp;
+	released = 0;
+	disconnected = 0;
+
+	socket_t* socket = socket_create(NULL, &conn);
+	socket->flush_delay = flush_delay;
+	socket->disconnect_cb = lost;
+	return socket;
+}
+
+static void fill(uint8_t* buffer, uint16_t length, uint8_t seed) {
+	uint16_t i = 0;
+	while (i < length) {
+		buffer[i] = seed + i * 7;
+		i++;
+	}
+}
+
+static void test_large_segment(void) {
+	socket_t* socket = setup(0);
+	static uint8_t big[4000];
+	uint8_t small[10];
+	fill(big, sizeof(big), 1);
+	fill(small, sizeof(small), 99);
+
+	// a queued buffer larger than one send goes out in pieces, each one waits for its acknowledgement
+	CHECK(socket_queue(socket, big, sizeof(big), release, NULL));
+	CHECK(fake_sent_calls == 1);
+	CHECK(socket->in_flight == SOCKET_SEGMENT_LENGTH_MAX);
+	CHECK(socket_write(socket, small, sizeof(small)));
+	CHECK(fake_sent_calls == 1);
+
+	fake_ack(&conn);
+	CHECK(fake_sent_calls == 2);
+	CHECK(released == 0);
+	fake_ack(&conn);
+	CHECK(fake_sent_calls == 3);
+	CHECK(socket->in_flight == sizeof(big) - 2 * SOCKET_SEGMENT_LENGTH_MAX);
+	fake_ack(&conn);
+	CHECK(released == 1);
+	CHECK(socket->in_flight == sizeof(small));
+	fake_ack(&conn);
+	CHECK(socket_idle(socket));
+	CHECK(socket->in_flight == 0);
+
+	CHECK(fake_wire_length == sizeof(big) + sizeof(small));
+	CHECK(memcmp(fake_wire, big, sizeof(big)) == 0);
+	CHECK(memcmp(fake_wire + sizeof(big), small, sizeof(small)) == 0);
+	socket_destroy(socket, true);
+}
+
+static void test_in_flight_untouched(void) {
+	socket_t* socket = setup(0);
+	uint8_t a[10];
+	uint8_t b[10];
+	fill(a, sizeof(a), 1);
+	fill(b, sizeof(b), 50);
+
+	// bytes on the wire are not appended to, a second write starts a new segment
+	CHECK(socket_write(socket, a, sizeof(a)));
+	CHECK(socket->in_flight == sizeof(a));
+	CHECK(socket_write(socket, b, sizeof(b)));
+	CHECK(socket->head != socket->tail);
+	CHECK(socket->head->length == sizeof(a));
+
+	fake_ack(&conn);
+	fake_ack(&conn);
+	CHECK(socket_idle(socket));
+	CHECK(fake_wire_length == sizeof(a) + sizeof(b));
+	CHECK(memcmp(fake_wire, a, sizeof(a)) == 0);
+	CHECK(memcmp(fake_wire + sizeof(a), b, sizeof(b)) == 0);
+	socket_destroy(socket, true);
+}
+
+static void test_coalesce(void) {
+	socket_t* socket = setup(5);
+	uint8_t a[10];
+	fill(a, sizeof(a), 3);
+
+	// small writes wait for the flush timer and leave as one send
+	CHECK(socket_write(socket, a, sizeof(a)));
+	CHECK(socket_write(socket, a, sizeof(a)));
+	CHECK(socket_write(socket, a, sizeof(a)));
+	CHECK(fake_sent_calls == 0);
+	fake_advance(4);
+	CHECK(fake_sent_calls == 0);
+	fake_advance(1);
+	CHECK(fake_sent_calls == 1);
+	CHECK(socket->in_flight == 3 * sizeof(a));
+	fake_ack(&conn);
+	CHECK(socket_idle(socket));
+
+	// an explicit flush does not wait
+	CHECK(socket_write(socket, a, sizeof(a)));
+	socket_flush(socket);
+	CHECK(fake_sent_calls == 2);
+	CHECK(!fake_armed(&socket->flush_timer));
+	socket_destroy(socket, true);
+}
+
+static void test_send_retry(void) {
+	socket_t* socket = setup(0);
+	uint8_t a[100];
+	fill(a, sizeof(a), 7);
+
+	// lwip out of memory, the segment is offered again from the flush timer
+	fake_sent_result = ESPCONN_MEM;
+	CHECK(socket_queue(socket, a, sizeof(a), release, NULL));
+	CHECK(fake_sent_calls == 1);
+	CHECK(socket->in_flight == 0);
+	CHECK(fake_armed(&socket->flush_timer));
+	fake_advance(SOCKET_RETRY_DELAY);
+	CHECK(fake_sent_calls == 2);
+
+	fake_sent_result = ESPCONN_OK;
+	fake_advance(SOCKET_RETRY_DELAY);
+	CHECK(fake_sent_calls == 3);
+	CHECK(socket->in_flight == sizeof(a));
+	CHECK(socket->retries == 0);
+	fake_ack(&conn);
+	CHECK(released == 1);
+	CHECK(socket_idle(socket));
+	CHECK(fake_wire_length == sizeof(a));
+	CHECK(memcmp(fake_wire, a, sizeof(a)) == 0);
+	socket_destroy(socket, true);
+}
+
+static void test_send_given_up(void) {
+	socket_t* socket = setup(0);
+	uint8_t a[100];
+
+	// a connection that never takes the data again is closed, not left waiting
+	fake_sent_result = ESPCONN_MEM;
+	CHECK(socket_queue(socket, a, sizeof(a), release, NULL));
+	fake_advance(SOCKET_RETRY_DELAY * SOCKET_RETRY_MAX);
+	CHECK(fake_sent_calls == SOCKET_RETRY_MAX + 1);
+	CHECK(fake_disconnects == 0);
+	fake_advance(SOCKET_RETRY_DELAY);
+	CHECK(fake_sent_calls == SOCKET_RETRY_MAX + 1);
+	CHECK(fake_disconnects == 1);
+	CHECK(released == 1);
+	CHECK(socket_idle(socket));
+	CHECK(!fake_armed(&socket->flush_timer));
+
+	// the owner hears about it through the usual callback
+	tcp.disconnect_callback(&conn);
+	CHECK(disconnected == 1);
+	socket_destroy(socket, true);
+}
+
+static void test_disconnect_releases(void) {
+	socket_t* socket = setup(0);
+	uint8_t a[100];
+
+	CHECK(socket_queue(socket, a, sizeof(a), release, NULL));
+	CHECK(socket_queue(socket, a, sizeof(a), release, NULL));
+	tcp.disconnect_callback(&conn);
+	CHECK(released == 2);
+	CHECK(disconnected == 1);
+	CHECK(socket->in_flight == 0);
+	socket_destroy(socket, true);
+}
+
+int main(int argc, char** argv) {
+	test_large_segment();
+	test_in_flight_untouched();
+	test_coalesce();
+	test_send_retry();
+	test_send_given_up();
+	test_disconnect_releases();
+	return fake_done("socket_test");
+}
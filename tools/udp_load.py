@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Load test for the UDP fast path.
+
+Sends complete send requests as datagrams at a fixed rate and reports the
+achieved rate, the acknowledged results and what got lost on the way.
+
+    type(1) flags(1) sequence(2) frequency(4) length(2) times(2 * length)
+
+Every datagram asks for an ACK and carries a sequence number, the device
+answers with
+
+    type(1) flags(1) sequence(2) result(1)
+
+Datagrams share the per-client send limit with TCP sends, anything above
+it comes back as rejected.
+"""
+
+import argparse
+import select
+import socket
+import struct
+import sys
+import time
+
+SEND_REQUEST = 0
+SEND_RESPONSE = 1
+
+FLAG_ACK = 0x01
+FLAG_SEQUENCE = 0x02
+
+HEAD = struct.Struct(">BBHIH")
+ACK = struct.Struct(">BBHB")
+
+RESULTS = ("sent", "expired", "cancelled", "rejected")
+
+
+def datagram(sequence, frequency, times):
+    head = HEAD.pack(SEND_REQUEST, FLAG_ACK | FLAG_SEQUENCE, sequence, frequency, len(times))
+    return head + struct.pack(">%dH" % len(times), *times)
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def run(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setblocking(False)
+    target = (args.host, args.port)
+
+    # a short nec like frame, mark and space pairs in microseconds
+    times = ([9000, 4500] + [560, 1690, 560, 560] * args.times)[:args.times]
+
+    pending = {}
+    latencies = []
+    results = [0] * len(RESULTS)
+    unknown = 0
+    late = 0
+    sent = 0
+    send_errors = 0
+
+    interval = 1.0 / args.rate
+    start = time.monotonic()
+    end = start + args.duration
+    next_send = start
+
+    while True:
+        now = time.monotonic()
+        if now >= end + args.timeout:
+            break
+
+        if now < end and now >= next_send:
+            sequence = sent & 0xFFFF
+            try:
+                sock.sendto(datagram(sequence, args.frequency, times), target)
+            except OSError:
+                send_errors += 1
+            pending[sequence] = now
+            sent += 1
+            next_send += interval
+            # a client that fell behind does not burst to catch up
+            if next_send < now - interval:
+                next_send = now
+
+        wait = max(0.0, min(next_send, end + args.timeout) - time.monotonic())
+        readable, _, _ = select.select([sock], [], [], wait if now < end else min(wait, 0.01))
+        if not readable:
+            continue
+
+        while True:
+            try:
+                data, _ = sock.recvfrom(64)
+            except BlockingIOError:
+                break
+            if len(data) != ACK.size:
+                unknown += 1
+                continue
+            kind, _, sequence, result = ACK.unpack(data)
+            if kind != SEND_RESPONSE:
+                unknown += 1
+                continue
+            sent_at = pending.pop(sequence, None)
+            if sent_at is None:
+                late += 1
+                continue
+            latencies.append((time.monotonic() - sent_at) * 1000.0)
+            if result < len(results):
+                results[result] += 1
+            else:
+                unknown += 1
+
+    elapsed = min(time.monotonic(), end) - start
+    acked = len(latencies)
+    lost = len(pending)
+
+    print("target      %s:%d, %d times per frame" % (args.host, args.port, len(times)))
+    print("requested   %.1f/s for %.1f s" % (args.rate, args.duration))
+    print("achieved    %.1f/s (%d datagrams, %d send errors)" % (sent / elapsed if elapsed > 0 else 0.0, sent, send_errors))
+    print("acked       %.1f/s (%d)" % (acked / elapsed if elapsed > 0 else 0.0, acked))
+    print("results     " + ", ".join("%s %d" % (name, results[i]) for i, name in enumerate(RESULTS)))
+    print("lost        %d (%.2f%%)" % (lost, 100.0 * lost / sent if sent else 0.0))
+    print("late/other  %d/%d" % (late, unknown))
+    print("latency ms  p50 %.1f, p90 %.1f, p99 %.1f, max %.1f" % (
+            percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+            max(latencies) if latencies else 0.0))
+
+    return 0 if sent > 0 else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="UDP fast path load test")
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=1234)
+    parser.add_argument("--rate", type=float, default=10.0, help="datagrams per second")
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds to send")
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for the last ACKs")
+    parser.add_argument("--times", type=int, default=68, help="times per frame, at most 512")
+    parser.add_argument("--frequency", type=int, default=38000)
+    args = parser.parse_args()
+
+    if not 2 <= args.times <= 512:
+        parser.error("--times must be between 2 and 512")
+    if args.rate <= 0:
+        parser.error("--rate must be positive")
+    return run(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())